@@ -2,9 +2,44 @@
 
 // Including necessary libraries
 #include "main.h"          					// Include main header file
-#include <stdio.h>         					// Include standard input/output library
 #include <string.h>        					// Include string manipulation library
 #include <stdbool.h>						// Include boolean data type
+#include "scheduler.h"						// Include event scheduler
+#include "valve.h"							// Include valve motion engine
+#include "pattern.h"						// Include LED and buzzer pattern engine
+#include "logger.h"							// Include asynchronous UART logger
+#include "fmt.h"							// Include lightweight number formatter
+#include "trace.h"							// Include pipeline latency trace
+#include "power.h"							// Include power state accounting
+#include "backup.h"							// Include retained state
+#include "wake.h"							// Include RTC wake schedule
+#include "clock.h"							// Include clock scaling
+#include "timebase.h"						// Include wake latency measurement
+#include "battery.h"						// Include battery measurement
+#include "soc.h"							// Include battery state of charge
+#include "probe.h"							// Include flood probe inputs
+
+#define SLEEP_TIMEOUT	5000				// Idle time before entering STOP mode (ms)
+#define ALERT_INTERVAL	5000				// Flood alert repeat interval (ms)
+#define SLEEP_RETRY		50					// Recheck interval while outputs are still active (ms)
+#define TEST_PAUSE		1500				// Alert and pause before the test mode reopens the valve (ms)
+
+// Worst-case flood detect to valve closed latency (ms), from the first probe falling edge
+// until the emergency ramp reaches the closed position with the valve idle beforehand:
+//   debounce K x interval = 100 + power-up settle 50 + emergency ramp 19 x 4 x 2.28 = 173
+//   + up to one TIM3 update period of phase alignment = about 326 ms, rounded up.
+// A flood during an opening motion reverses it immediately and skips the power-up settle.
+#define FLOOD_CLOSE_BUDGET	350
+#define MESSAGE_SIZE	112					// Longest line is the battery report, 102 characters with every field at its widest
+#define DUMP_RETRY		20					// Wait for logger space while dumping the trace (ms)
+#define LOW_BATTERY_MV	SOC_CUTOFF_MV		// Low battery threshold (mV), 2950 counts at 3.3 V through the 1:2 divider
+#define SAG_MIN_MV		4200				// Lowest loaded battery voltage that still moves the servo reliably
+#ifndef PROBE_TEST_EVERY
+#define PROBE_TEST_EVERY	24				// Battery wakes between probe self-tests, about once a day
+#endif
+#ifndef BATTERY_REPORT_EVERY
+#define BATTERY_REPORT_EVERY	24			// Hourly watchdog checks between full battery reports, 0 reports only when low
+#endif
 
 // External peripheral handlers declaration
 extern ADC_HandleTypeDef hadc1;      		// Declare ADC handler
@@ -12,242 +47,475 @@ extern TIM_HandleTypeDef htim3;      		// Declare Timer 3 handler
 extern UART_HandleTypeDef huart2;    		// Declare UART handler
 extern RTC_HandleTypeDef hrtc;				// Declare RTC handler
 extern TIM_HandleTypeDef htim16;			// Declare Timer 16 handler
+extern TIM_HandleTypeDef htim14;			// Declare Timer 14 handler
 
 // Global variable declaration
-char message[40];                     		// Buffer to store messages
+char message[MESSAGE_SIZE];            		// Buffer to store messages
 
-uint8_t wupFlag = 1;  						// Initialize wake-up flag
-volatile static uint8_t mbatt_counter;		// Initialize mbatt_counter flag
 static uint8_t Low_battery;					// Initialize low battery flag
+static uint16_t lastBatt = 0;				// Initialize previous battery reading for the trend
+static uint8_t battChecks = 0;				// Initialize watchdog checks since the last battery report
+static uint8_t probeWakes = 0;				// Initialize battery wakes since the last probe self-test
 
-volatile static uint8_t valve_open;			// Initialize valve open flag
+static uint8_t testStage = 0;				// Initialize test mode stage
+static uint8_t exercising = 0;				// Initialize quiet valve exercise flag
 volatile static uint8_t floodFlag = 0;    	// Initialize flood flag
 volatile static uint8_t buttonState = 0;  	// Initialize button state
 volatile static uint32_t holdTime = 0;    	// Initialize button hold time
 volatile static uint32_t releaseTime = 0;	// Initialize button release time
 volatile static uint32_t pressDuration = 0; // Initialize button press duration
-
-static uint32_t alert_time = 0;				// Initialize alert time
-static uint32_t sleep_time = 0;				// Initialize sleep time
+volatile static uint32_t floodEdgeTime = 0;	// Initialize flood edge detection time
+static uint32_t floodCloseMax = 0;			// Initialize worst measured flood close latency
+static uint8_t rxCmd;						// Initialize UART command byte
+static uint8_t dumpIndex = 0;				// Initialize trace dump position
+static uint8_t dumping = 0;					// Initialize trace dump in progress flag
 
 // Function prototypes
-void openValve();                    		// Function prototype for opening the valve
-void closeValve();                    		// Function prototype for closing the valve
+void openValve(valve_profile_t profile);	// Function prototype for opening the valve
+void closeValve(valve_profile_t profile);	// Function prototype for closing the valve
 void alert(void);							// Function prototype for activating the buzzer and warning LED
 void resetFloodEvent();						// Function prototype for resetting the flood event
 uint16_t measureBattery(void);        		// Function prototype for measuring battery voltage
 void monitorBattery(void);					// Function prototype for monitoring battery voltage
+char *formatBattery(char *dst, uint16_t vBatt);	// Function prototype for formatting the battery report line
+void benchFormat(void);						// Function prototype for timing the formatter in core cycles
+void compareBattery(void);					// Function prototype for measuring the battery in both ADC modes
 void statusled(void);						// Function prototype for system status led
 void batteryled(void);						// Function prototype for activating battery LED
 void console(char *log);              		// Function prototype for transmitting messages via UART
+void reportAwakeTime(void);					// Function prototype for reporting scheduler awake time
+void dumpTrace(void);						// Function prototype for dumping the trace ring via UART
+void reportPower(void);						// Function prototype for reporting power state residency
+void reportWake(void);						// Function prototype for reporting wake to handler latency
+void reportSoc(void);						// Function prototype for reporting the battery state of charge
+void checkSag(void);						// Function prototype for reporting the battery sag of a valve motion
+void reportProbes(void);					// Function prototype for reporting the flood probes
+void testProbes(void);						// Function prototype for the flood probe self-test
+static void probeEvent(uint8_t probe, probe_event_t evt);	// Function prototype for the flood probe callback
+static void dispatch(sched_event_t evt);	// Function prototype for the scheduler event dispatcher
+static bool runJobs(void);					// Function prototype for the periodic jobs of a wake
+static void valveDone(valve_cmd_t cmd);		// Function prototype for the valve motion completion callback
 
 // Main application function
 int app_main(void)
 {
+	clock_init();
+	tb_init();
+	sched_init();
+	power_init();
+	battery_init();
+	probe_init(probeEvent);
 	// Initialize message buffer with default message
 	strcpy(message, "EFloodGuard(v3.1)\r\n");
 	// Send initialization message
 	console(message);
+	HAL_UART_Receive_IT(&huart2, &rxCmd, 1);	// Listen for console commands
 
-	// Check if the flood flag is set
-	if(HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_6) == GPIO_PIN_SET)
+	// Restore the state retained across a reset, the valve position is only trusted if no motion was cut short
+	bool valveKnown = backup_init() && !backup_get(BACKUP_VALVE_MOVING);
+	soc_init();
+	if(valveKnown)
+	{
+		valve_restore(backup_get(BACKUP_VALVE_OPEN));
+	}
+	sched_set_sleep(backup_get(BACKUP_DEEP_SLEEP) ? SCHED_SLEEP_DEEP : SCHED_SLEEP_STOP);
+
+	// Check if the flood flag is set, a latched flood stays latched until the user resets it
+	if(!probe_any_wet() && !backup_get(BACKUP_FLOOD_LATCH))
 	{
 		floodFlag = 0;
-		HAL_Delay(100);
-		openValve();
+		if(!valveKnown || !valve_is_open())
+		{
+			HAL_Delay(100);
+			openValve(VALVE_PROFILE_NORMAL);
+		}
 	}
 	else
 	{
 		floodFlag = 1;
-		HAL_Delay(100);
-		closeValve();
+		backup_set(BACKUP_FLOOD_LATCH, true);
+		floodEdgeTime = HAL_GetTick();
+		if(!valveKnown || valve_is_open())
+		{
+			HAL_Delay(100);
+			closeValve(VALVE_PROFILE_EMERGENCY);
+		}
+		sched_post(EVT_FLOOD);
 	}
 	HAL_Delay(500);
 	alert();
-	// Main loop
-	while(1)
+	wake_init();
+	wake_program();
+	sched_timer_start(TMR_SLEEP, SLEEP_TIMEOUT, EVT_SLEEP_TIMER);
+	// Main loop, the core sleeps between events
+	sched_run(dispatch);
+	return 0;
+}
+
+// Function to dispatch scheduler events to their handlers
+static void dispatch(sched_event_t evt)
+{
+	switch(evt)
 	{
-		// Get current time
-		uint32_t now;
-		now = HAL_GetTick();
+	case EVT_BUTTON_RELEASE:
 		// Test Mode activated by long pressing the button
 		if(pressDuration >= 2000 && !floodFlag)
 		{
-			pressDuration = 0;
-			statusled();
-			closeValve();
-			alert();
-			HAL_Delay(500);
 			statusled();
-			openValve();
+			testStage = 1;
+			exercising = 0;
+			closeValve(VALVE_PROFILE_NORMAL);
 		}
 		// Servicing the short button press during a flood event
 		else if(floodFlag && pressDuration >= 1000)
 		{
-			pressDuration = 0;
 			resetFloodEvent();
 		}
-		// Close the valve if the flood flag is set
-		if (floodFlag)
+		pressDuration = 0;
+		break;
+
+	case EVT_FLOOD:
+	case EVT_ALERT_TIMER:
+		// Repeat the alert and keep the valve closed while the flood flag is set
+		if(floodFlag)
+		{
+			strcpy(message, "Flood\r\n");
+			console(message);
+			alert();
+			testStage = 0;					// A flood aborts the test mode sequence
+			exercising = 0;
+			if(valve_is_open())
+			{
+				closeValve(VALVE_PROFILE_EMERGENCY);
+			}
+			sched_timer_start(TMR_ALERT, ALERT_INTERVAL, EVT_ALERT_TIMER);
+		}
+		break;
+
+	case EVT_VALVE_DONE:
+		checkSag();
+		// Test Mode reopens the valve once it has been closed
+		if(testStage == 1)
 		{
-			if(now - alert_time > 5000)
+			if(!exercising)
 			{
-				alert_time = now;
-				strcpy(message, "Flood\r\n");
-				console(message);
 				alert();
 			}
-			if(valve_open == 1)
+			sched_timer_start(TMR_TEST, TEST_PAUSE, EVT_TEST_STEP);
+		}
+		else if(testStage == 2)
+		{
+			testStage = 0;
+			exercising = 0;
+		}
+		else if(floodFlag && !valve_is_open())
+		{
+			// Measure the detect to closed latency against the budget
+			uint32_t latency = valve_reached_time() - floodEdgeTime;
+			if(latency > floodCloseMax)
 			{
-				closeValve();
-				strcpy(message, "valve closed\r\n");
-				console(message);
+				floodCloseMax = latency;
 			}
+			char *p = fmt_str(message, "valve closed ");
+			p = fmt_u32(p, latency);
+			p = fmt_str(p, "ms max ");
+			p = fmt_u32(p, floodCloseMax);
+			fmt_str(p, (latency > FLOOD_CLOSE_BUDGET) ? "ms over budget\r\n" : "ms\r\n");
+			console(message);
 		}
+		sched_timer_start(TMR_SLEEP, SLEEP_TIMEOUT, EVT_SLEEP_TIMER);
+		break;
 
-		if(now - sleep_time >= 5000 && !floodFlag && wupFlag)
+	case EVT_TEST_STEP:
+		if(testStage == 1)
 		{
-			statusled();
-			if (mbatt_counter == 59)
+			if(!exercising)
 			{
-				monitorBattery();
+				statusled();
 			}
-			wupFlag = 0;
-			HAL_SuspendTick();
-			HAL_PWR_EnterSTOPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);    	// Enable Stop mode
+			testStage = 2;
+			openValve(VALVE_PROFILE_NORMAL);
+		}
+		break;
+
+	case EVT_SLEEP_TIMER:
+		if(!floodFlag && runJobs())
+		{
+			sched_timer_start(TMR_SLEEP, 0, EVT_STOP_READY);
+		}
+		break;
+
+	case EVT_WAKE_JOBS:
+		// The jobs of an RTC wake run at once, an idle timeout armed by user activity keeps running
+		if(!floodFlag && runJobs() && !sched_timer_active(TMR_SLEEP))
+		{
+			sched_timer_start(TMR_SLEEP, 0, EVT_STOP_READY);
+		}
+		break;
+
+	case EVT_STOP_READY:
+		// The timers and USART2 stop in STOP mode, so stay awake until outputs, logs and debounce windows are done
+		if(floodFlag || testStage)
+		{
+			break;
+		}
+		if(valve_busy() || pattern_busy() || log_busy() || probe_busy() || dumping)
+		{
+			sched_timer_start(TMR_SLEEP, SLEEP_RETRY, EVT_STOP_READY);
+		}
+		else
+		{
+			sched_request_stop();
+		}
+		break;
+
+	case EVT_UART_CMD:
+		// Console commands: 't' dumps the trace ring, 'p' reports power state residency, 'd' toggles deep sleep,
+		// 'w' reports the wake to handler latency, 's' reports the battery state of charge, 'b' measures the battery,
+		// 'f' reports the flood probes, 'x' runs the probe self-test, 'c' times the formatter in core cycles,
+		// 'o' measures the battery with the median scan and the oversampler
+		if(rxCmd == 't' && !dumping)
+		{
+			dumping = 1;
+			dumpIndex = 0;
+			trace_pause(true);
+			dumpTrace();
+		}
+		else if(rxCmd == 'p')
+		{
+			reportPower();
+		}
+		else if(rxCmd == 'w')
+		{
+			reportWake();
+		}
+		else if(rxCmd == 's')
+		{
+			reportSoc();
+		}
+		else if(rxCmd == 'b')
+		{
+			monitorBattery();
+		}
+		else if(rxCmd == 'f')
+		{
+			reportProbes();
+		}
+		else if(rxCmd == 'c')
+		{
+			benchFormat();
+		}
+		else if(rxCmd == 'o')
+		{
+			compareBattery();
+		}
+		else if(rxCmd == 'x')
+		{
+			testProbes();
+			reportProbes();
+		}
+		else if(rxCmd == 'd')
+		{
+			bool deep = sched_get_sleep() != SCHED_SLEEP_DEEP;
+			sched_set_sleep(deep ? SCHED_SLEEP_DEEP : SCHED_SLEEP_STOP);
+			backup_set(BACKUP_DEEP_SLEEP, deep);
+			console(deep ? "sleep deep\r\n" : "sleep stop\r\n");
 		}
+		HAL_UART_Receive_IT(&huart2, &rxCmd, 1);
+		sched_timer_start(TMR_SLEEP, SLEEP_TIMEOUT, EVT_SLEEP_TIMER);
+		break;
+
+	case EVT_TRACE_DUMP:
+		dumpTrace();
+		break;
+
+	default:
+		break;
 	}
-	return 0;
+}
+
+// Function to run the periodic jobs that are due and program the next RTC wake
+// Returns false when a valve exercise started, the sleep timer is re-armed when it ends
+static bool runJobs(void)
+{
+	statusled();
+	uint8_t due = wake_due();
+	// The analog watchdog checks the battery, the full measurement and log only run when it is
+	// low, when the check failed or when the periodic report is due
+	if(due & WAKE_BIT(WAKE_BATTERY))
+	{
+		if(battery_check(LOW_BATTERY_MV) != BATT_CHECK_OK)
+		{
+			monitorBattery();
+		}
+		else if(BATTERY_REPORT_EVERY && ++battChecks >= BATTERY_REPORT_EVERY)
+		{
+			battChecks = 0;
+			monitorBattery();
+			reportAwakeTime();
+		}
+		// The probe self-test shares the wake, it costs about 0.1 ms per probe
+		if(++probeWakes >= PROBE_TEST_EVERY)
+		{
+			probeWakes = 0;
+			testProbes();
+		}
+	}
+	// Exercise the valve with the test sequence, without the alert
+	if((due & WAKE_BIT(WAKE_EXERCISE)) && !testStage)
+	{
+		exercising = 1;
+		testStage = 1;
+		closeValve(VALVE_PROFILE_NORMAL);
+		return false;
+	}
+	wake_program();
+	return true;
 }
 
 // Callback function for rising edge interrupt on GPIO EXTI line
 void HAL_GPIO_EXTI_Rising_Callback(uint16_t GPIO_Pin)
 {
-	HAL_ResumeTick();
-	sleep_time = HAL_GetTick();
-	wupFlag = 1;
-	if(GPIO_Pin == GPIO_PIN_15)
+	tb_wake_handler(TB_WAKE_BUTTON);
+	sched_timer_start(TMR_SLEEP, SLEEP_TIMEOUT, EVT_SLEEP_TIMER);
+	if(GPIO_Pin == BUTTON_Pin)
 	{
 		if (buttonState == 1)
 		{
 			releaseTime = HAL_GetTick();
 			pressDuration = releaseTime - holdTime;
+			sched_post(EVT_BUTTON_RELEASE);
 		}
 		buttonState = 0;
 	}
 }
 
+// Callback function for the flood probes, a confirmed flood on any probe closes the valve
+static void probeEvent(uint8_t probe, probe_event_t evt)
+{
+	if(evt == PROBE_EDGE)
+	{
+		tb_wake_handler(TB_WAKE_FLOOD);
+		sched_timer_start(TMR_SLEEP, SLEEP_TIMEOUT, EVT_SLEEP_TIMER);
+		wake_force(WAKE_BATTERY);			// Check the battery after any user or sensor activity
+	}
+	else if(evt == PROBE_START)
+	{
+		floodEdgeTime = HAL_GetTick();		// First edge of a debounce window
+	}
+	else if(evt == PROBE_CONFIRMED)
+	{
+		floodFlag = 1; // Set flood flag
+		backup_set(BACKUP_FLOOD_LATCH, true);
+		// Fast path, start closing from the ISR whatever the main loop is doing
+		if(valve_is_open())
+		{
+			closeValve(VALVE_PROFILE_EMERGENCY);
+		}
+		sched_post(EVT_FLOOD);
+	}
+}
+
 // Callback function for falling edge interrupt on GPIO EXTI line
 void HAL_GPIO_EXTI_Falling_Callback(uint16_t GPIO_Pin)
 {
-	HAL_ResumeTick();
-	sleep_time = HAL_GetTick();
-	wupFlag = 1;
-	mbatt_counter = 59;
-
-	// Handle button press
-	if(GPIO_Pin == GPIO_PIN_15)
+	// Handle button press, flood probe edges are serviced by probe_irq before the HAL sees them
+	if(GPIO_Pin == BUTTON_Pin)
 	{
+		tb_wake_handler(TB_WAKE_BUTTON);
 		buttonState = 1;
 		holdTime = HAL_GetTick(); 		// Record button hold time
 	}
-	// Handle flood flag
-	if(GPIO_Pin == GPIO_PIN_6)
-	{
-		HAL_TIM_Base_Start_IT(&htim16);
-	}
+	sched_timer_start(TMR_SLEEP, SLEEP_TIMEOUT, EVT_SLEEP_TIMER);
+	wake_force(WAKE_BATTERY);				// Check the battery after any user or sensor activity
 }
 
-// Callback function for TIM16 period elapsed interrupt
+// Callback function for RTC alarm A interrupt
 void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *hrtc)
 {
-	HAL_ResumeTick();
-	sleep_time = HAL_GetTick();
-	wupFlag = 1;
-	mbatt_counter++;
-	if(mbatt_counter > 59)
-	{
-		mbatt_counter = 0;
-	}
+	tb_wake_handler(TB_WAKE_RTC);
+	sched_post(EVT_WAKE_JOBS);				// Run the due jobs and go back to STOP without the idle timeout
 }
+
+// Callback function for TIM16 period elapsed interrupt
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
   /* Prevent unused argument(s) compilation warning */
   if(htim == &htim16)
   {
-	  if(HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_6) == GPIO_PIN_RESET)
-	  {
-		  floodFlag = 1; // Set flood flag
-	  }
-	  HAL_TIM_Base_Stop_IT(&htim16);
+	  probe_tim_update();
+  }
+  else if(htim == &htim3)
+  {
+	  valve_tim_update();
+  }
+  else if(htim == &htim14)
+  {
+	  pattern_tim_update();
   }
 }
-// Function to open the valve
-void openValve()
+
+// Function to open the valve, the motion completes in the background
+void openValve(valve_profile_t profile)
 {
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_9, GPIO_PIN_SET);    	// Activate valve
-	HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_1);             	// Start PWM signal for valve control
-	HAL_Delay(50);
-	for(uint16_t i = 1800; i >= 900; i-=50)
+	bool idle = !valve_busy();
+	backup_set(BACKUP_VALVE_MOVING, true);
+	valve_request(VALVE_OPEN, profile, valveDone);
+	if(idle)
 	{
-		__HAL_TIM_SET_COMPARE(&htim3, TIM_CHANNEL_1, i);   	// Set PWM duty cycle for valve opening
-		HAL_Delay(30);
+		battery_sag_start();				// Once the motion is under way, its first samples are taken at rest
 	}
+}
 
-	HAL_Delay(50);
-	HAL_TIM_PWM_Stop(&htim3, TIM_CHANNEL_1);              	// Stop PWM signal
-	HAL_Delay(50);
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_9, GPIO_PIN_RESET);  	// Deactivate valve
-	valve_open = 1;
+// Function to close the valve, the motion completes in the background
+void closeValve(valve_profile_t profile)
+{
+	bool idle = !valve_busy();
+	backup_set(BACKUP_VALVE_MOVING, true);
+	valve_request(VALVE_CLOSE, profile, valveDone);
+	if(idle)
+	{
+		battery_sag_start();				// A flood close from the TIM16 ISR starts the servo before the ADC setup
+	}
 }
 
-// Function to close the valve
-void closeValve()
+// Callback function for valve motion completion, called from the TIM3 or DMA interrupt
+static void valveDone(valve_cmd_t cmd)
 {
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_9, GPIO_PIN_SET);    	// Activate valve
-	HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_1);             	// Start PWM signal for valve control
-	HAL_Delay(50);
-	for(uint16_t i = 900; i <= 1800; i+=50)
-	{
-		__HAL_TIM_SET_COMPARE(&htim3, TIM_CHANNEL_1, i);   	// Set PWM duty cycle for valve Closing
-		HAL_Delay(30);
-	}
-	HAL_Delay(50);
-	HAL_TIM_PWM_Stop(&htim3, TIM_CHANNEL_1);              	// Stop PWM signal
-	HAL_Delay(50);
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_9, GPIO_PIN_RESET);  	// Deactivate valve
-	valve_open = 0;
+	backup_set(BACKUP_VALVE_OPEN, cmd == VALVE_OPEN);
+	backup_set(BACKUP_VALVE_MOVING, false);
+	sched_post(EVT_VALVE_DONE);
 }
 
 // Function to reset flood event
 void resetFloodEvent()
 {
 	// Check if the button is pressed and the valve is open
-	if ((HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_15) == GPIO_PIN_SET) && HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_6) == GPIO_PIN_SET)
+	if ((HAL_GPIO_ReadPin(BUTTON_GPIO_Port, BUTTON_Pin) == GPIO_PIN_SET) && !probe_any_wet())
 	{
-		if(valve_open == 0)
+		if(!valve_is_open())
 		{
-			openValve();            // Open the valve
+			openValve(VALVE_PROFILE_GENTLE);	// Open the valve
 		}
 		strcpy(message, "valve open\r\n");
 		console(message);
 		floodFlag = 0;          	// Clear the flood flag
+		probe_clear();
+		backup_set(BACKUP_FLOOD_LATCH, false);
 	}
 }
 
 // Function to measure battery voltage
 uint16_t measureBattery(void)
 {
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_15, SET);           	// Enable battery voltage measurement
-	HAL_ADC_Start(&hadc1);                                	// Start ADC conversion
-	HAL_ADC_PollForConversion(&hadc1, 1000);              	// Wait for ADC conversion to complete
-	volatile uint16_t analogbatt = HAL_ADC_GetValue(&hadc1);       	// Read ADC value
-	HAL_Delay(5);
-	HAL_ADC_Stop(&hadc1);                                 	// Stop ADC conversion
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_15, RESET);         	// Disable battery voltage measurement
+	uint16_t analogbatt = battery_measure();	// Read battery millivolts, the divider is only on while needed
 
-	// Check battery voltage threshold
-	if(analogbatt < 2950)
+	// Check battery voltage threshold, a failed measurement keeps the previous state
+	if(analogbatt == 0)
+	{
+		return 0;
+	}
+	if(analogbatt < LOW_BATTERY_MV)
 	{
 		Low_battery = 1;			// Set low battery flag if voltage is below threshold
 	}
@@ -262,48 +530,348 @@ uint16_t measureBattery(void)
 void monitorBattery(void)
 {
 	uint16_t vBatt = measureBattery();            			// Measure battery voltage
+	if(vBatt == 0)
+	{
+		console("Battery measurement failed\r\n");
+		return;
+	}
 	if(Low_battery)
 	{
 		batteryled();
 	}
-	sprintf(message, "Battery Voltage: %d\r\n", vBatt); 	// Format battery voltage message
+	formatBattery(message, vBatt);							// Format battery voltage message
 	console(message);                             			// Send battery voltage message via UART
+	lastBatt = vBatt;
+	soc_update(vBatt);
+	reportSoc();
+}
+
+// Function to format the battery report line, the longest console line
+char *formatBattery(char *dst, uint16_t vBatt)
+{
+	char *p = fmt_str(dst, "Battery Voltage: ");
+	p = fmt_u32(p, vBatt);
+	p = fmt_str(p, "mV VDDA ");
+	p = fmt_u32(p, battery_timing()->vdda_mv);
+	p = fmt_str(p, "mV trend ");
+	p = fmt_i32(p, lastBatt ? (int32_t)vBatt - lastBatt : 0);
+	p = fmt_str(p, "mV spread ");
+	p = fmt_u32(p, battery_timing()->spread_mv);
+	p = fmt_str(p, "mV sample ");
+	p = fmt_u32(p, battery_timing()->divider_us);
+	p = fmt_str(p, "us ");
+	p = fmt_u32(p, battery_sample_nj());
+	return fmt_str(p, "nJ\r\n");
+}
+
+// Function to count the core cycles of formatting the battery line with SysTick, the span stays below one tick
+void benchFormat(void)
+{
+	uint32_t load = SysTick->LOAD + 1;		// Core cycles per millisecond
+	__disable_irq();
+	uint32_t t0 = SysTick->VAL;
+	uint32_t t1 = SysTick->VAL;
+	formatBattery(message, lastBatt);
+	uint32_t t2 = SysTick->VAL;
+	__enable_irq();
+	uint32_t overhead = (t0 >= t1) ? t0 - t1 : t0 + load - t1;	// The counter runs down and reloads
+	uint32_t cycles = (t1 >= t2) ? t1 - t2 : t1 + load - t2;
+	cycles = (cycles > overhead) ? cycles - overhead : 0;
+	char *p = fmt_str(message, "fmt battery line ");
+	p = fmt_u32(p, cycles);
+	p = fmt_str(p, " cycles ");
+	p = fmt_u32(p, cycles * 1000 / load);
+	fmt_str(p, "us\r\n");
+	console(message);
+}
+
+// Function to measure the battery in both ADC modes back to back and report reading, spread, time and energy
+void compareBattery(void)
+{
+	static const char *const modes[] = { "scan ", "ovs " };
+	battery_mode_t keep = battery_get_mode();
+	for(uint8_t m = BATT_MODE_SCAN; m <= BATT_MODE_OVERSAMPLE; m++)
+	{
+		battery_set_mode((battery_mode_t)m);
+		uint16_t mv = battery_measure();
+		const battery_timing_t *t = battery_timing();
+		char *p = fmt_str(message, "Mode ");
+		p = fmt_str(p, modes[m]);
+		p = fmt_u32(p, mv);
+		p = fmt_str(p, "mV spread ");
+		p = fmt_u32(p, t->spread_mv);
+		p = fmt_str(p, "mV conv ");
+		p = fmt_u32(p, t->conversion_us);
+		p = fmt_str(p, "us ");
+		p = fmt_u32(p, battery_sample_nj());
+		fmt_str(p, "nJ\r\n");
+		console(message);
+	}
+	battery_set_mode(keep);
 }
 
+// LED and buzzer patterns, durations in ms alternating on and off
+static const uint16_t blinkStatus[] = { 100 };
+static const uint16_t blinkBattery[] = { 200 };
+static const uint16_t blinkAlert[] = { 1000 };
+
 // Function to control status LED
 void statusled(void)
 {
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, GPIO_PIN_SET);
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_SET);
-	HAL_Delay(100);
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_RESET);
+	pattern_play(PATTERN_OUT_LED, blinkStatus, 1);
+	pattern_play(PATTERN_OUT_BUZZER, blinkStatus, 1);
 }
 
 // Function to activate battery LED
 void batteryled(void)
 {
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, GPIO_PIN_SET);		// Activate battery LED
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_9, GPIO_PIN_SET);
-	HAL_Delay(200);											// Delay for LED indication
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_9, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, GPIO_PIN_RESET);	// Deactivate battery LED
+	pattern_play(PATTERN_OUT_LED, blinkBattery, 1);		// Activate battery LED
+	pattern_play(PATTERN_OUT_WARNING, blinkBattery, 1);
 }
 
 // Function to activate buzzer and warning LED
 void alert(void)
 {
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_SET);		// Activate buzzer
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_9, GPIO_PIN_SET);		// Activate warning LED
-	HAL_Delay(1000);										// Delay for alert indication
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_8, GPIO_PIN_RESET);	// Deactivate buzzer
-	HAL_GPIO_WritePin(GPIOB, GPIO_PIN_9, GPIO_PIN_RESET);	// Deactivate warning LED
+	pattern_play(PATTERN_OUT_BUZZER, blinkAlert, 1);		// Activate buzzer
+	pattern_play(PATTERN_OUT_WARNING, blinkAlert, 1);		// Activate warning LED
 }
 
-// Function to transmit messages via UART
+// Function to transmit messages via UART, the line is queued and sent by DMA
 void console(char *log)
 {
-	HAL_UART_Transmit(&huart2, (uint8_t *)log, strlen(log), HAL_MAX_DELAY);  // Transmit message via UART
-	HAL_Delay(10);
-	memset(log, '\0', strlen(log));  // Clear message buffer
+	trace_record(TRACE_UART_LOG, log_write(log, strlen(log)));	// Queue message for UART transmission
+}
+
+// Function to report the awake time spent per scheduler event via UART
+void reportAwakeTime(void)
+{
+	for(uint8_t evt = EVT_NONE + 1; evt < EVT_COUNT; evt++)
+	{
+		const sched_stats_t *st = sched_stats((sched_event_t)evt);
+		if(st->count == 0)
+		{
+			continue;
+		}
+		char *p = fmt_str(message, "E");
+		p = fmt_u32(p, evt);
+		p = fmt_str(p, " n=");
+		p = fmt_u32(p, st->count);
+		p = fmt_str(p, " avg=");
+		p = fmt_u32(p, st->busy_us / st->count);
+		p = fmt_str(p, "us max=");
+		p = fmt_u32(p, st->max_us);
+		fmt_str(p, "us\r\n");
+		console(message);
+	}
+}
+
+// Function to report how far the battery sagged under the servo load and flag a pack that may brown out
+void checkSag(void)
+{
+	battery_sag_t sag;
+	if(!battery_sag_end(&sag))
+	{
+		return;
+	}
+	bool weak = sag.min_mv < SAG_MIN_MV;
+	if(weak)
+	{
+		batteryled();
+	}
+	char *p = fmt_str(message, "Sag rest ");
+	p = fmt_u32(p, sag.rest_mv);
+	p = fmt_str(p, "mV loaded ");
+	p = fmt_u32(p, sag.loaded_mv);
+	p = fmt_str(p, "mV min ");
+	p = fmt_u32(p, sag.min_mv);
+	p = fmt_str(p, "mV after ");
+	p = fmt_u32(p, sag.after_mv);
+	p = fmt_str(p, "mV R ");
+	p = fmt_u32(p, sag.resistance_mohm);
+	fmt_str(p, weak ? "mohm weak\r\n" : "mohm\r\n");
+	console(message);
+}
+
+// Function to report the level, flood flag and counters of every flood probe
+void reportProbes(void)
+{
+	for(uint8_t i = 0; i < probe_count(); i++)
+	{
+		const probe_stats_t *st = probe_stats(i);
+		char *p = fmt_str(message, "Probe ");
+		p = fmt_str(p, probe_name(i));
+		p = fmt_str(p, probe_wet(i) ? " wet" : " dry");
+		p = fmt_str(p, probe_flooded(i) ? " flooded edges " : " edges ");
+		p = fmt_u32(p, st->edges);
+		p = fmt_str(p, " floods ");
+		p = fmt_u32(p, st->floods);
+		p = fmt_str(p, " rejected ");
+		p = fmt_u32(p, st->rejects);
+		fmt_str(p, "\r\n");
+		console(message);
+		p = fmt_str(message, "  tests ");
+		p = fmt_u32(p, st->tests);
+		p = fmt_str(p, " stuck high ");
+		p = fmt_u32(p, st->stuck_high);
+		p = fmt_str(p, " low ");
+		p = fmt_u32(p, st->stuck_low);
+		p = fmt_str(p, " last ");
+		p = fmt_str(p, probe_health_name((probe_health_t)st->health));
+		fmt_str(p, "\r\n");
+		console(message);
+	}
+}
+
+// Function to self-test the flood probes and report every faulty one
+void testProbes(void)
+{
+	uint8_t faults = probe_selftest();
+	for(uint8_t i = 0; i < probe_count(); i++)
+	{
+		if(faults & (1 << i))
+		{
+			char *p = fmt_str(message, "Probe ");
+			p = fmt_str(p, probe_name(i));
+			p = fmt_str(p, " fault ");
+			p = fmt_str(p, probe_health_name((probe_health_t)probe_stats(i)->health));
+			p = fmt_str(p, " test ");
+			p = fmt_u32(p, probe_test_us());
+			p = fmt_str(p, "us ");
+			p = fmt_u32(p, (power_run_ua() * probe_test_us() / 1000) * POWER_SUPPLY_MV / 1000);	// uA x us x mV is fJ, scaled to nJ
+			fmt_str(p, "nJ\r\n");
+			console(message);
+		}
+	}
+	if(faults)
+	{
+		batteryled();						// Same service indication as a weak battery
+	}
+}
+
+// Function to report the battery state of charge and the days left before the low battery cutoff
+void reportSoc(void)
+{
+	const soc_status_t *soc = soc_status();
+	char *p = fmt_str(message, "SoC ");
+	p = fmt_u32(p, soc->permille / 10);
+	p = fmt_str(p, "% avg ");
+	p = fmt_u32(p, soc->mv);
+	p = fmt_str(p, "mV load ");
+	p = fmt_u32(p, soc->load_ua);
+	p = fmt_str(p, "uA slope ");
+	p = fmt_u32(p, soc->slope_ppm);
+	p = fmt_str(p, "ppm/day left ");
+	p = fmt_u32(p, soc->days);
+	fmt_str(p, " days\r\n");
+	console(message);
+}
+
+// Function to report the time and entries of every power state and the estimated consumption
+void reportPower(void)
+{
+	for(uint8_t st = POWER_RUN; st < POWER_STATE_COUNT; st++)
+	{
+		char *p = fmt_str(message, "P ");
+		p = fmt_str(p, power_name((power_state_t)st));
+		p = fmt_str(p, " t=");
+		p = fmt_time(p, power_time_ms((power_state_t)st));
+		p = fmt_str(p, "s n=");
+		p = fmt_u32(p, power_entries((power_state_t)st));
+		fmt_str(p, "\r\n");
+		console(message);
+	}
+	// Executing time per clock level, each one charged its own run current
+	static const char *const clocks[CLOCK_LEVEL_COUNT] = { "3MHz", "12MHz", "48MHz" };
+	for(uint8_t lvl = 0; lvl < CLOCK_LEVEL_COUNT; lvl++)
+	{
+		char *p = fmt_str(message, "P ");
+		p = fmt_str(p, clocks[lvl]);
+		p = fmt_str(p, " t=");
+		p = fmt_time(p, power_level_ms((clock_level_t)lvl));
+		fmt_str(p, "s\r\n");
+		console(message);
+	}
+	uint32_t avg = power_avg_ua();
+	char *p = fmt_str(message, "P up=");
+	p = fmt_time(p, power_uptime_ms());
+	p = fmt_str(p, "s avg=");
+	p = fmt_u32(p, avg);
+	p = fmt_str(p, "uA ");
+	p = fmt_mv(p, avg * 24);				// uAh per day printed as mAh
+	fmt_str(p, "mAh/day\r\n");
+	console(message);
+}
+
+// Function to report the wake to handler latency of every wake source for both STOP profiles
+void reportWake(void)
+{
+	static const char *const names[TB_WAKE_COUNT] = { "flood", "button", "rtc" };
+	static const char *const profiles[SCHED_SLEEP_COUNT] = { "stop ", "deep " };
+	for(uint8_t prof = 0; prof < SCHED_SLEEP_COUNT; prof++)
+	{
+		for(uint8_t src = 0; src < TB_WAKE_COUNT; src++)
+		{
+			const tb_wake_stats_t *st = tb_wake_stats((tb_wake_t)src, (sched_sleep_t)prof);
+			char *p = fmt_str(message, "W ");
+			p = fmt_str(p, profiles[prof]);
+			p = fmt_str(p, names[src]);
+			p = fmt_str(p, " n=");
+			p = fmt_u32(p, st->count);
+			p = fmt_str(p, " avg=");
+			p = fmt_u32(p, st->count ? st->total_us / st->count : 0);
+			p = fmt_str(p, "us last=");
+			p = fmt_u32(p, st->last_us);
+			p = fmt_str(p, "us max=");
+			p = fmt_u32(p, st->max_us);
+			fmt_str(p, "us\r\n");
+			console(message);
+		}
+	}
+}
+
+// Function to dump the trace ring via UART, continues later when the logger is full
+void dumpTrace(void)
+{
+	uint8_t count = trace_count();
+	while(dumpIndex < count)
+	{
+		const trace_entry_t *e = trace_get(dumpIndex);
+		uint32_t delta = dumpIndex ? e->time_us - trace_get(dumpIndex - 1)->time_us : 0;
+		char *p = fmt_str(message, "T ");
+		p = fmt_u32(p, e->time_us);
+		p = fmt_str(p, " +");
+		p = fmt_u32(p, delta);
+		p = fmt_str(p, "us ");
+		p = fmt_str(p, trace_name(e->id));
+		p = fmt_str(p, " ");
+		p = fmt_u32(p, e->arg);
+		p = fmt_str(p, "\r\n");
+		if(log_space() < (uint16_t)(p - message))
+		{
+			sched_timer_start(TMR_DUMP, DUMP_RETRY, EVT_TRACE_DUMP);
+			return;
+		}
+		log_write(message, p - message);
+		dumpIndex++;
+	}
+	trace_pause(false);
+	dumping = 0;
+}
+
+// Callback function for a received console command byte
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if(huart == &huart2)
+	{
+		sched_post(EVT_UART_CMD);
+	}
+}
+
+// Callback function for UART errors, restarts command reception after an overrun
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if(huart == &huart2)
+	{
+		HAL_UART_Receive_IT(&huart2, &rxCmd, 1);
+	}
 }
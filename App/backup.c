@@ -0,0 +1,54 @@
+// Program Description: Flood guard state retained in the PWR backup registers.
+
+#include "backup.h"
+
+#define BACKUP_REG_MAGIC	PWR_BKP_DR0		// Holds BACKUP_MAGIC once initialised
+#define BACKUP_REG_FLAGS	PWR_BKP_DR1		// Holds the backup_flag_t bits
+#define BACKUP_REG_WORDS	PWR_BKP_DR2		// First of the backup_word_t registers
+
+_Static_assert(BACKUP_REG_WORDS + BACKUP_WORD_COUNT <= PWR_BKP_NUMBER, "Not enough PWR backup registers for the retained words");
+
+// Function to check the retained state and clear it when it was lost
+bool backup_init(void)
+{
+	if (HAL_PWREx_BKUPRead(BACKUP_REG_MAGIC) == BACKUP_MAGIC)
+	{
+		return true;
+	}
+	HAL_PWREx_BKUPWrite(BACKUP_REG_FLAGS, 0);
+	for (uint8_t i = 0; i < BACKUP_WORD_COUNT; i++)
+	{
+		HAL_PWREx_BKUPWrite(BACKUP_REG_WORDS + i, 0);
+	}
+	HAL_PWREx_BKUPWrite(BACKUP_REG_MAGIC, BACKUP_MAGIC);
+	return false;
+}
+
+// Function to read a retained flag
+bool backup_get(backup_flag_t flag)
+{
+	return (HAL_PWREx_BKUPRead(BACKUP_REG_FLAGS) & flag) != 0;
+}
+
+// Function to update a retained flag
+void backup_set(backup_flag_t flag, bool on)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t flags = HAL_PWREx_BKUPRead(BACKUP_REG_FLAGS);
+	flags = on ? (flags | flag) : (flags & ~flag);
+	HAL_PWREx_BKUPWrite(BACKUP_REG_FLAGS, (uint16_t)flags);
+	__set_PRIMASK(primask);
+}
+
+// Function to read a retained word
+uint16_t backup_read(backup_word_t word)
+{
+	return (uint16_t)HAL_PWREx_BKUPRead(BACKUP_REG_WORDS + word);
+}
+
+// Function to update a retained word
+void backup_write(backup_word_t word, uint16_t value)
+{
+	HAL_PWREx_BKUPWrite(BACKUP_REG_WORDS + word, value);
+}
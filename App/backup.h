@@ -0,0 +1,36 @@
+// Critical state retained in the PWR backup registers.
+// The registers keep their content across a system reset, so a unit reset in
+// the middle of a flood comes back with the valve latched closed.
+
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include "main.h"
+#include <stdbool.h>
+
+#define BACKUP_MAGIC		0xEF61			// Marks the retained state as valid
+
+// Retained flags
+typedef enum
+{
+	BACKUP_FLOOD_LATCH = 0x01,				// Flood detected and not yet reset by the user
+	BACKUP_VALVE_OPEN = 0x02,				// Last completed valve motion was an open
+	BACKUP_VALVE_MOVING = 0x04,				// A valve motion was started and has not completed
+	BACKUP_DEEP_SLEEP = 0x08,				// Deep sleep profile selected
+} backup_flag_t;
+
+// Retained 16-bit words
+typedef enum
+{
+	BACKUP_WORD_SOC_EMA = 0,				// Smoothed battery voltage, see soc.c
+	BACKUP_WORD_SOC_LOAD,					// Smoothed supply current of the energy model
+	BACKUP_WORD_COUNT
+} backup_word_t;
+
+bool backup_init(void);						// Validate the retained state, returns false after a power on
+bool backup_get(backup_flag_t flag);		// Read a retained flag
+void backup_set(backup_flag_t flag, bool on);	// Update a retained flag, safe from ISRs
+uint16_t backup_read(backup_word_t word);	// Read a retained word, 0 after a power on
+void backup_write(backup_word_t word, uint16_t value);	// Update a retained word
+
+#endif /* BACKUP_H */
@@ -0,0 +1,438 @@
+// Program Description: Low energy battery voltage measurement.
+
+#include "battery.h"
+#include "scheduler.h"
+#include "power.h"
+#include <stdbool.h>
+
+#if BATT_OVS_BITS > 16 || BATT_OVS_BITS < 12
+#error "BATT_OVS_RATIO_LOG2 and BATT_OVS_SHIFT must give a 12 to 16 bit result"
+#endif
+
+extern ADC_HandleTypeDef hadc1;				// Declare ADC handler
+extern DMA_HandleTypeDef hdma_adc1;			// Declare ADC DMA handler
+
+#define BATT_CONFIG_WATCH	(BATT_MODE_OVERSAMPLE + 1)	// Single divider rank checked by AWD1
+#define BATT_CONFIG_SAG		(BATT_MODE_OVERSAMPLE + 2)	// Divider converted on every TIM3 update, circular DMA
+#define BATT_CONFIG_NONE	0xFF			// ADC not configured by this module yet
+
+static volatile bool conversion_done;		// Set by the DMA transfer complete interrupt
+static volatile bool conversion_error;		// Set by the ADC or DMA error interrupt
+static volatile bool out_of_window;			// Set by the analog watchdog interrupt
+static uint16_t samples[BATT_RANKS];		// VREFINT and divider readings written by DMA
+static battery_timing_t timing;
+static battery_mode_t mode;					// Mode used by battery_measure
+static uint8_t config = BATT_CONFIG_NONE;	// Mode the ADC is currently initialised for
+static uint16_t watch_counts;				// AWD1 low threshold applied in the watch configuration
+static uint16_t watch_mv;					// Battery level watch_counts was worked out for
+static uint16_t watch_vdda;					// VDDA watch_counts was worked out for
+static volatile bool converting;			// A measurement or check owns the ADC
+static volatile bool sag_active;			// A sag capture owns the ADC
+static uint16_t burst[BATT_BURST];			// Sag capture samples, each half reduced when DMA fills it
+static volatile uint32_t sag_sum;			// Sum of the reduced sag samples
+static volatile uint16_t sag_count;			// Number of reduced sag samples
+static volatile uint16_t sag_min;			// Lowest sag sample
+static volatile uint16_t sag_next;			// Start of the half buffer not yet reduced
+static volatile uint16_t sag_seen;			// Samples reduced so far, the first ones are the rest voltage
+static volatile uint32_t rest_sum;			// Sum of the rest samples
+static uint16_t rest_mv;					// Last measurement before the capture
+
+// Function to switch the ADC to auto power off and auto wait, one DMA transfer per trigger
+void battery_init(void)
+{
+	hadc1.Init.LowPowerAutoPowerOff = ENABLE;	// The ADC is powered only while converting
+	hadc1.Init.LowPowerAutoWait = ENABLE;	// A rank waits until DMA has read the previous one, no overrun
+	hadc1.Init.EOCSelection = ADC_EOC_SEQ_CONV;
+	hadc1.Init.Oversampling.Ratio = (BATT_OVS_RATIO_LOG2 - 1) << ADC_CFGR2_OVSR_Pos;
+	hadc1.Init.Oversampling.RightBitShift = BATT_OVS_SHIFT << ADC_CFGR2_OVSS_Pos;
+	hadc1.Init.Oversampling.TriggeredMode = ADC_TRIGGEREDMODE_SINGLE_TRIGGER;	// All conversions of the ratio from one trigger
+	battery_set_mode(BATT_MODE_OVERSAMPLE);
+}
+
+// Function to initialise the ADC for a measurement mode or the watch, the ADC is disabled between measurements
+static bool battery_configure(uint8_t next)
+{
+	ADC_ChannelConfTypeDef sConfig = {0};
+	ADC_AnalogWDGConfTypeDef sWatch = {0};
+	bool ok = true;
+	if (next == config)
+	{
+		return true;
+	}
+	config = next;
+	hadc1.Init.NbrOfConversion = (next == BATT_MODE_SCAN) ? BATT_RANKS : (next == BATT_MODE_OVERSAMPLE) ? 2 : 1;
+	hadc1.Init.OversamplingMode = (next == BATT_MODE_OVERSAMPLE) ? ENABLE : DISABLE;
+	hadc1.Init.ExternalTrigConv = (next == BATT_CONFIG_SAG) ? ADC_EXTERNALTRIG_T3_TRGO : ADC_SOFTWARE_START;
+	hadc1.Init.ExternalTrigConvEdge = (next == BATT_CONFIG_SAG) ? ADC_EXTERNALTRIGCONVEDGE_RISING : ADC_EXTERNALTRIGCONVEDGE_NONE;
+	hadc1.Init.DMAContinuousRequests = (next == BATT_CONFIG_SAG) ? ENABLE : DISABLE;
+	ok &= HAL_ADC_Init(&hadc1) == HAL_OK;
+	uint32_t dma_mode = (next == BATT_CONFIG_SAG) ? DMA_CIRCULAR : DMA_NORMAL;
+	if (hdma_adc1.Init.Mode != dma_mode)
+	{
+		hdma_adc1.Init.Mode = dma_mode;
+		HAL_DMA_Init(&hdma_adc1);
+	}
+
+	// VREFINT on rank 1 and the divider on the remaining ranks, the watch and the sag capture convert the divider alone
+	sConfig.SamplingTime = ADC_SAMPLINGTIME_COMMON_1;
+	for (uint8_t rank = 0; rank < hadc1.Init.NbrOfConversion; rank++)
+	{
+		sConfig.Channel = (rank || next >= BATT_CONFIG_WATCH) ? ADC_CHANNEL_12 : ADC_CHANNEL_VREFINT;
+		sConfig.Rank = ADC_REGULAR_RANK_1 + rank * (ADC_REGULAR_RANK_2 - ADC_REGULAR_RANK_1);
+		ok &= HAL_ADC_ConfigChannel(&hadc1, &sConfig) == HAL_OK;
+	}
+
+	// AWD1 flags a divider reading below the threshold, it stays off for the measurements
+	sWatch.WatchdogNumber = ADC_ANALOGWATCHDOG_1;
+	sWatch.WatchdogMode = (next == BATT_CONFIG_WATCH) ? ADC_ANALOGWATCHDOG_SINGLE_REG : ADC_ANALOGWATCHDOG_NONE;
+	sWatch.Channel = ADC_CHANNEL_12;
+	sWatch.ITMode = (next == BATT_CONFIG_WATCH) ? ENABLE : DISABLE;
+	sWatch.HighThreshold = 0xFFF;
+	sWatch.LowThreshold = watch_counts;
+	ok &= HAL_ADC_AnalogWDGConfig(&hadc1, &sWatch) == HAL_OK;
+	if (next != BATT_CONFIG_SAG)
+	{
+		ok &= HAL_ADCEx_Calibration_Start(&hadc1) == HAL_OK;	// The sag capture keeps the factor, it may start from an ISR
+	}
+	if (!ok)
+	{
+		config = BATT_CONFIG_NONE;			// Initialise again from scratch next time
+	}
+	return ok;
+}
+
+// Function to select the mode of battery_measure, the ADC is reconfigured by the next measurement
+void battery_set_mode(battery_mode_t next)
+{
+	mode = next;
+}
+
+// Function to get the measurement mode
+battery_mode_t battery_get_mode(void)
+{
+	return mode;
+}
+
+// Function to compute the reciprocal of a VREFINT reading with Newton-Raphson, the M0+ has no divider
+// Returns x in Q30 with 1 / vref = x * 2^shift / 2^46
+static uint32_t battery_reciprocal(uint16_t vref, uint8_t *shift)
+{
+	uint8_t s = 0;
+	uint32_t n = vref ? vref : 1;
+	while (n < 0x8000)
+	{
+		n <<= 1;							// Normalise to [0.5, 1) in Q16
+		s++;
+	}
+	uint32_t x = 3031741620u - (uint32_t)(((uint64_t)2021161080u * n) >> 16);	// 48/17 - 32/17 n, Q30
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		uint32_t e = 0x80000000u - (uint32_t)(((uint64_t)n * x) >> 16);	// 2 - n x
+		x = (uint32_t)(((uint64_t)x * e) >> 30);
+	}
+	*shift = s;
+	return x;
+}
+
+// Function to take the ADC for a measurement or a check, fails while a sag capture owns it
+static bool battery_claim(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	bool claimed = !sag_active;
+	converting = claimed;
+	__set_PRIMASK(primask);
+	return claimed;
+}
+
+// Function to power the divider and convert the configured ranks into samples with the core asleep
+// Returns false if the ADC did not start or the scan did not complete within BATT_TIMEOUT_MS
+static bool battery_convert(void)
+{
+	power_begin(POWER_BATT_SENSE);
+	HAL_GPIO_WritePin(BATT_SENSE_EN_GPIO_Port, BATT_SENSE_EN_Pin, GPIO_PIN_SET);	// Enable battery voltage measurement
+	uint32_t start = sched_now_us();
+	while ((sched_now_us() - start) < BATT_SETTLE_US)
+	{
+	}
+
+	uint32_t conv = sched_now_us();
+	conversion_done = false;
+	conversion_error = false;
+	bool ok = HAL_ADC_Start_DMA(&hadc1, (uint32_t *)samples, hadc1.Init.NbrOfConversion) == HAL_OK;
+	// Sleep until the end of the scan, masked so the interrupt cannot slip in before WFI, SysTick bounds the wait
+	uint32_t tickstart = HAL_GetTick();
+	__disable_irq();
+	while (ok && !conversion_done && !conversion_error && (HAL_GetTick() - tickstart) < BATT_TIMEOUT_MS)
+	{
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+	ok = ok && conversion_done;
+	uint32_t end = sched_now_us();
+	HAL_ADC_Stop_DMA(&hadc1);				// Leave the ADC disabled so it can be reconfigured
+	if (!ok)
+	{
+		config = BATT_CONFIG_NONE;			// Reinitialise the ADC and its DMA channel before the next use
+	}
+
+	HAL_GPIO_WritePin(BATT_SENSE_EN_GPIO_Port, BATT_SENSE_EN_Pin, GPIO_PIN_RESET);	// Disable battery voltage measurement
+	power_end(POWER_BATT_SENSE);
+	timing.divider_us = end - start;
+	timing.conversion_us = end - conv;
+	return ok;
+}
+
+// Function to convert divider counts into battery millivolts against the last VDDA
+static uint16_t battery_counts_mv(uint32_t counts)
+{
+	return (uint16_t)((((counts * timing.vdda_mv) >> 12) * BATT_DIVIDER_Q8) >> 8);
+}
+
+// Function to measure the battery voltage, a sag capture in progress keeps the ADC
+uint16_t battery_measure(void)
+{
+	if (!battery_claim())
+	{
+		return rest_mv;
+	}
+	if (!battery_configure(mode) || !battery_convert())
+	{
+		converting = false;
+		return 0;
+	}
+
+	// Readings scaled to 16 bits
+	uint16_t vref;
+	uint16_t reading;
+	uint16_t spread = 0;
+	if (mode == BATT_MODE_OVERSAMPLE)
+	{
+		vref = samples[0] << (16 - BATT_OVS_BITS);
+		reading = samples[1] << (16 - BATT_OVS_BITS);
+	}
+	else
+	{
+		// Insertion sort of the divider samples, the median of 7 is the middle one
+		uint16_t *v = &samples[1];
+		for (uint8_t i = 1; i < BATT_SAMPLES; i++)
+		{
+			uint16_t x = v[i];
+			uint8_t j = i;
+			while (j > 0 && v[j - 1] > x)
+			{
+				v[j] = v[j - 1];
+				j--;
+			}
+			v[j] = x;
+		}
+		vref = samples[0] << 4;
+		reading = v[BATT_SAMPLES / 2] << 4;
+		spread = (v[BATT_SAMPLES - 1] - v[0]) << 4;
+	}
+
+	// VDDA = VREFINT_CAL_VREF * VREFINT_CAL / VREFINT, evaluated with the reciprocal
+	uint8_t s;
+	uint32_t x = battery_reciprocal(vref, &s);
+	uint32_t c = VREFINT_CAL_VREF * ((uint32_t)*VREFINT_CAL_ADDR << 4);
+	uint32_t k = (uint32_t)(((uint64_t)c * x) >> 30);	// VDDA in mV x 2^(16 - shift)
+	timing.vdda_mv = (s <= 16) ? k >> (16 - s) : k << (s - 16);
+	timing.spread_mv = (uint16_t)(((((uint64_t)spread * k) >> (32 - s)) * BATT_DIVIDER_Q8) >> 8);
+	rest_mv = (uint16_t)(((((uint64_t)reading * k) >> (32 - s)) * BATT_DIVIDER_Q8) >> 8);
+	converting = false;
+	return rest_mv;
+}
+
+// Function to check the battery against a low threshold with the analog watchdog
+battery_check_t battery_check(uint16_t low_mv)
+{
+	if (!battery_claim())
+	{
+		return BATT_CHECK_OK;
+	}
+	// Threshold in divider counts against the last known VDDA, worked out only when either one changes
+	uint16_t vdda = timing.vdda_mv ? timing.vdda_mv : POWER_SUPPLY_MV;
+	if (low_mv != watch_mv || vdda != watch_vdda)
+	{
+		// counts = low_mv x 4096 / gain / VDDA, with the reciprocal of VDDA instead of a division
+		uint8_t s;
+		uint32_t x = battery_reciprocal(vdda, &s);
+		uint32_t counts = (uint32_t)(((uint64_t)low_mv * (4096 * 256 / BATT_DIVIDER_Q8) * x) >> (46 - s));
+		if (counts > 0xFFF)
+		{
+			counts = 0xFFF;
+		}
+		if (counts != watch_counts && config == BATT_CONFIG_WATCH)
+		{
+			config = BATT_CONFIG_NONE;		// Thresholds are only applied by a full configuration
+		}
+		watch_counts = counts;
+		watch_mv = low_mv;
+		watch_vdda = vdda;
+	}
+
+	out_of_window = false;
+	bool ok = battery_configure(BATT_CONFIG_WATCH) && battery_convert();
+	converting = false;
+	if (!ok)
+	{
+		return BATT_CHECK_FAILED;
+	}
+	return out_of_window ? BATT_CHECK_LOW : BATT_CHECK_OK;
+}
+
+// Function to add a block of sag samples to the running statistics
+static void battery_sag_reduce(const uint16_t *v, uint16_t n)
+{
+	for (uint16_t i = 0; i < n; i++)
+	{
+		uint16_t index = sag_seen++;
+		if (index == 0)
+		{
+			continue;						// The divider may not have settled before the first TIM3 update
+		}
+		if (index <= BATT_SAG_REST)
+		{
+			rest_sum += v[i];				// Servo powered at its current position, the ramp has not started
+			continue;
+		}
+		sag_sum += v[i];
+		sag_count++;
+		if (v[i] < sag_min)
+		{
+			sag_min = v[i];
+		}
+	}
+}
+
+// Function to start sampling the divider on every TIM3 update, call right after a motion started from idle
+void battery_sag_start(void)
+{
+	// A motion reversal keeps the capture going, a measurement in progress keeps the ADC
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	bool busy = sag_active || converting;
+	if (!busy)
+	{
+		sag_active = true;
+	}
+	__set_PRIMASK(primask);
+	if (busy)
+	{
+		return;
+	}
+
+	sag_sum = 0;
+	sag_count = 0;
+	sag_min = 0xFFFF;
+	sag_next = 0;
+	sag_seen = 0;
+	rest_sum = 0;
+	// The capture is optional, a failure just leaves the motion without a sag report
+	if (!battery_configure(BATT_CONFIG_SAG))
+	{
+		sag_active = false;
+		return;
+	}
+	power_begin(POWER_BATT_SENSE);
+	HAL_GPIO_WritePin(BATT_SENSE_EN_GPIO_Port, BATT_SENSE_EN_Pin, GPIO_PIN_SET);	// The divider settles during the servo power up
+	if (HAL_ADC_Start_DMA(&hadc1, (uint32_t *)burst, BATT_BURST) != HAL_OK)	// Waits for the TIM3 updates
+	{
+		HAL_ADC_Stop_DMA(&hadc1);
+		config = BATT_CONFIG_NONE;
+		HAL_GPIO_WritePin(BATT_SENSE_EN_GPIO_Port, BATT_SENSE_EN_Pin, GPIO_PIN_RESET);
+		power_end(POWER_BATT_SENSE);
+		sag_active = false;
+	}
+}
+
+// Function to stop the capture and compare the loaded readings with the recovered voltage
+bool battery_sag_end(battery_sag_t *sag)
+{
+	if (!sag_active)
+	{
+		return false;
+	}
+
+	// Reduce what the callbacks have not, the abort drops a transfer interrupt still pending
+	__disable_irq();
+	HAL_ADC_Stop_DMA(&hadc1);
+	uint16_t written = BATT_BURST - __HAL_DMA_GET_COUNTER(&hdma_adc1);
+	if (written < sag_next)
+	{
+		written += BATT_BURST;				// Wrapped with the second half still pending
+	}
+	battery_sag_reduce(&burst[sag_next], written - sag_next);
+	__enable_irq();
+	HAL_GPIO_WritePin(BATT_SENSE_EN_GPIO_Port, BATT_SENSE_EN_Pin, GPIO_PIN_RESET);
+	power_end(POWER_BATT_SENSE);
+
+	sag_active = false;
+	sag->after_mv = battery_measure();		// Servo already off, also refreshes VDDA for the conversions below
+	sag->samples = sag_count;
+	if (sag_count == 0 || sag->after_mv == 0)
+	{
+		return false;
+	}
+	sag->rest_mv = battery_counts_mv(rest_sum / BATT_SAG_REST);
+	sag->loaded_mv = battery_counts_mv(sag_sum / sag_count);
+	sag->min_mv = battery_counts_mv(sag_min);
+	// mV over mA is ohms, the servo current comes from the energy model, rest and load share the conversion path
+	uint32_t drop = (sag->rest_mv > sag->loaded_mv) ? sag->rest_mv - sag->loaded_mv : 0;
+	sag->resistance_mohm = drop * 1000000 / POWER_UA_SERVO;
+	return true;
+}
+
+// Function to get the timing of the last measurement
+const battery_timing_t *battery_timing(void)
+{
+	return &timing;
+}
+
+// Function to estimate the energy of the last measurement, the core sleeps during the conversion
+uint32_t battery_sample_nj(void)
+{
+	// mV x uA x us is in fJ, the settling wait runs the core
+	uint32_t settle = timing.divider_us - timing.conversion_us;
+	uint32_t charge = POWER_UA_BATT_SENSE * timing.divider_us + power_run_ua() * settle
+					+ (POWER_UA_ADC + POWER_UA_SLEEP) * timing.conversion_us;	// uA x us
+	return (charge / 1000) * POWER_SUPPLY_MV / 1000;
+}
+
+// Callback function for the first half of the sag capture buffer
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc)
+{
+	if (sag_active)
+	{
+		battery_sag_reduce(burst, BATT_BURST / 2);
+		sag_next = BATT_BURST / 2;
+	}
+}
+
+// Callback function for the end of a battery scan, or of the second half of the sag capture buffer
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+	if (sag_active)
+	{
+		battery_sag_reduce(&burst[BATT_BURST / 2], BATT_BURST / 2);
+		sag_next = 0;
+	}
+	else
+	{
+		conversion_done = true;
+	}
+}
+
+// Callback function for ADC and DMA errors, ends the wait of a measurement
+void HAL_ADC_ErrorCallback(ADC_HandleTypeDef *hadc)
+{
+	conversion_error = true;
+}
+
+// Callback function for the analog watchdog, the divider reading was below the threshold
+void HAL_ADC_LevelOutOfWindowCallback(ADC_HandleTypeDef *hadc)
+{
+	out_of_window = true;
+}
@@ -0,0 +1,76 @@
+// Battery voltage measurement through the PB15 switched divider on PA12.
+// Every trigger converts VREFINT first and then the divider, either as a
+// 7 sample scan reduced to its median or through the hardware oversampler,
+// into RAM by DMA. The readings are turned into millivolts against the
+// factory VREFINT calibration, so they do not depend on VDDA. The divider is
+// powered only for its settling time and the conversions, the ADC powers
+// itself off afterwards and the core sleeps meanwhile. A check against the low
+// battery level is a single divider conversion compared by the analog
+// watchdog, the CPU only hears about it when the reading is below the level.
+// During a valve motion the divider is converted on every TIM3 update to see
+// how far the pack sags under the servo load, the first samples are taken
+// while the servo still holds its position and give the voltage at rest.
+
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include "main.h"
+#include <stdbool.h>
+
+#define BATT_SETTLE_US		200				// Divider settling time after PB15 is switched on
+#define BATT_TIMEOUT_MS		10				// Longest wait for a scan, a few hundred us when the ADC works
+#define BATT_RANKS			8				// Regular ranks in scan mode, VREFINT is rank 1
+#define BATT_SAMPLES		(BATT_RANKS - 1)	// Divider samples per scan
+#define BATT_DIVIDER_Q8		512				// Battery to PA12 gain (R1 + R2) / R2, in 1/256
+#define BATT_BURST			32				// Sag capture buffer, reduced every 16 TIM3 updates
+#define BATT_SAG_REST		4				// Capture samples averaged as the rest voltage, within the 50 ms servo power-up
+#define BATT_OVS_RATIO_LOG2	6				// Oversampling ratio 64, 1 to 8 for ratios 2 to 256
+#define BATT_OVS_SHIFT		2				// Right shift of the accumulated sum, 0 to 8
+#define BATT_OVS_BITS		(12 + BATT_OVS_RATIO_LOG2 - BATT_OVS_SHIFT)	// Resolution of an oversampled result, up to 16
+
+// Measurement modes
+typedef enum
+{
+	BATT_MODE_SCAN = 0,						// Median of the 7 divider ranks of the scan
+	BATT_MODE_OVERSAMPLE,					// Hardware oversampler, no CPU accumulation
+} battery_mode_t;
+
+// Result of a check against the low battery level
+typedef enum
+{
+	BATT_CHECK_OK = 0,						// Above the level, or skipped while a sag capture owns the ADC
+	BATT_CHECK_LOW,							// AWD1 saw the divider below the level
+	BATT_CHECK_FAILED,						// The ADC did not start or complete, nothing is known
+} battery_check_t;
+
+// Timing of the last measurement
+typedef struct
+{
+	uint32_t divider_us;					// Time the divider was powered
+	uint32_t conversion_us;					// Time from ADC start to the end of the scan
+	uint16_t spread_mv;						// Largest minus smallest sample of the scan, 0 when oversampling
+	uint16_t vdda_mv;						// Supply of the ADC derived from VREFINT
+} battery_timing_t;
+
+// Battery sag over a valve motion
+typedef struct
+{
+	uint16_t rest_mv;						// Average of the first samples, servo powered but still, 0 if none
+	uint16_t loaded_mv;						// Average with the servo powered
+	uint16_t min_mv;						// Deepest sag with the servo powered
+	uint16_t after_mv;						// Measured once the servo is off again
+	uint16_t samples;						// Loaded samples captured
+	uint32_t resistance_mohm;				// Internal resistance from the sag and the servo current
+} battery_sag_t;
+
+void battery_init(void);					// Configure the ADC for low power measurements in oversampling mode
+void battery_set_mode(battery_mode_t mode);	// Select the mode of the next measurements
+battery_mode_t battery_get_mode(void);		// Current measurement mode
+uint16_t battery_measure(void);				// Measure the battery, returns millivolts, 0 when the ADC failed
+battery_check_t battery_check(uint16_t low_mv);	// Single conversion checked by AWD1 against low_mv
+void battery_sag_start(void);				// Sample the divider on every TIM3 update, call right after a motion starts from idle, safe from ISRs
+bool battery_sag_end(battery_sag_t *sag);	// Stop the capture and measure the recovery, false without a capture
+const battery_timing_t *battery_timing(void);	// Timing of the last measurement
+uint32_t battery_sample_nj(void);			// Modelled energy of the last measurement in nJ
+
+#endif /* BATTERY_H */
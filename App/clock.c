@@ -0,0 +1,196 @@
+// Program Description: HSIDIV based clock scaling with peripheral re-timing.
+
+#include "clock.h"
+#include "power.h"
+
+extern TIM_HandleTypeDef htim3;				// Declare Timer 3 handler
+extern TIM_HandleTypeDef htim14;			// Declare Timer 14 handler
+extern TIM_HandleTypeDef htim16;			// Declare Timer 16 handler
+extern UART_HandleTypeDef huart2;			// Declare UART2 handler
+
+#define CLOCK_TIMCLK_RUN	12000000		// Timer clock of the reset configuration
+
+// Bus configuration of one level
+typedef struct
+{
+	uint32_t hsidiv;						// RCC_HSI_DIVx
+	uint32_t apbdiv;						// RCC_APB1_DIVx
+	uint32_t latency;						// FLASH_LATENCY_x
+	uint32_t hclk;							// Resulting HCLK
+	uint32_t pclk;							// Resulting PCLK
+	uint32_t timclk;						// Resulting timer clock, twice PCLK when the APB is divided
+} clock_config_t;
+
+static const clock_config_t configs[CLOCK_LEVEL_COUNT] =
+{
+	[CLOCK_IDLE] = { RCC_HSI_DIV16, RCC_APB1_DIV1, FLASH_LATENCY_0, 3000000, 3000000, 3000000 },
+	[CLOCK_RUN] = { RCC_HSI_DIV4, RCC_APB1_DIV1, FLASH_LATENCY_0, 12000000, 12000000, 12000000 },
+	[CLOCK_FAST] = { RCC_HSI_DIV1, RCC_APB1_DIV4, FLASH_LATENCY_1, 48000000, 12000000, 24000000 },
+};
+
+static TIM_HandleTypeDef *const timers[] = { &htim3, &htim14, &htim16 };
+#define CLOCK_TIMER_COUNT	(sizeof(timers) / sizeof(timers[0]))
+
+static uint32_t base_div[CLOCK_TIMER_COUNT];	// Prescaler ratio of each timer at CLOCK_RUN
+static clock_level_t level;
+static volatile uint8_t holds;				// clock_hold_t bits
+static uint32_t tick_carry_us;				// SysTick phase lost by reloading, returned to the tick
+
+// Function to capture the timer prescalers of the reset configuration
+void clock_init(void)
+{
+	for (uint8_t i = 0; i < CLOCK_TIMER_COUNT; i++)
+	{
+		base_div[i] = timers[i]->Instance->PSC + 1;
+	}
+	level = CLOCK_RUN;
+	holds = 0;
+	tick_carry_us = 0;
+}
+
+// Function to load a new prescaler at once without disturbing the counter or raising an update
+static void clock_retime_timer(TIM_HandleTypeDef *htim, uint32_t div)
+{
+	TIM_TypeDef *tim = htim->Instance;
+	uint32_t cr1 = tim->CR1;
+	uint32_t cnt = tim->CNT;
+	htim->Init.Prescaler = div - 1;
+	tim->PSC = div - 1;
+	tim->CR1 = cr1 | TIM_CR1_URS;			// UG reloads the prescaler without setting UIF or a DMA request
+	tim->EGR = TIM_EGR_UG;
+	tim->CNT = cnt;
+	tim->CR1 = cr1;
+}
+
+// Function to reprogram the clocks and re-time the peripherals, called with interrupts masked
+static void clock_switch(clock_level_t next)
+{
+	const clock_config_t *from = &configs[level];
+	const clock_config_t *to = &configs[next];
+
+	// Part of the current millisecond already elapsed, lost when SysTick is reloaded
+	uint32_t load = SysTick->LOAD + 1;
+	tick_carry_us += ((load - SysTick->VAL) * 1000) / load;
+
+	// Raise the flash latency before speeding up, lower it after slowing down
+	if (to->latency > from->latency)
+	{
+		__HAL_FLASH_SET_LATENCY(to->latency);
+		while (__HAL_FLASH_GET_LATENCY() != to->latency)
+		{
+		}
+	}
+	// Keep PCLK at or below both end points while the dividers change
+	if (to->hclk > from->hclk)
+	{
+		MODIFY_REG(RCC->CFGR, RCC_CFGR_PPRE, to->apbdiv);
+		__HAL_RCC_HSI_CONFIG(to->hsidiv);
+	}
+	else
+	{
+		__HAL_RCC_HSI_CONFIG(to->hsidiv);
+		MODIFY_REG(RCC->CFGR, RCC_CFGR_PPRE, to->apbdiv);
+	}
+	if (to->latency < from->latency)
+	{
+		__HAL_FLASH_SET_LATENCY(to->latency);
+	}
+	SystemCoreClock = to->hclk;
+
+	SysTick->LOAD = to->hclk / 1000 - 1;
+	SysTick->VAL = 0;
+	if (tick_carry_us >= 1000)
+	{
+		tick_carry_us -= 1000;
+		HAL_IncTick();
+	}
+
+	for (uint8_t i = 0; i < CLOCK_TIMER_COUNT; i++)
+	{
+		// The servo timer has no exact ratio at 3 MHz, CLOCK_HOLD_SERVO keeps it from running there
+		uint32_t scaled = base_div[i] * (to->timclk / 1000);
+		if ((scaled % (CLOCK_TIMCLK_RUN / 1000)) == 0)
+		{
+			clock_retime_timer(timers[i], scaled / (CLOCK_TIMCLK_RUN / 1000));
+		}
+	}
+
+	if (to->pclk != from->pclk)
+	{
+		CLEAR_BIT(huart2.Instance->CR1, USART_CR1_UE);	// BRR is only writable with the USART disabled
+		huart2.Instance->BRR = UART_DIV_SAMPLING16(to->pclk, huart2.Init.BaudRate, huart2.Init.ClockPrescaler);
+		SET_BIT(huart2.Instance->CR1, USART_CR1_UE);
+	}
+	power_clock(next);						// Run current changes with the core clock
+	level = next;
+}
+
+// Function to switch the clock level, a PCLK change waits until USART2 has nothing to send
+bool clock_set(clock_level_t next)
+{
+	bool done = true;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (next < clock_floor())
+	{
+		next = clock_floor();
+	}
+	if (next != level)
+	{
+		bool uart_idle = huart2.gState == HAL_UART_STATE_READY && __HAL_UART_GET_FLAG(&huart2, UART_FLAG_TC);
+		if (configs[next].pclk == configs[level].pclk || uart_idle)
+		{
+			clock_switch(next);
+		}
+		else
+		{
+			done = false;
+		}
+	}
+	__set_PRIMASK(primask);
+	return done;
+}
+
+// Function to get the current clock level
+clock_level_t clock_get(void)
+{
+	return level;
+}
+
+// Function to get the clock of TIM3, TIM14 and TIM16 at the current level
+uint32_t clock_timer_hz(void)
+{
+	return configs[level].timclk;
+}
+
+// Function to get the lowest level the holds allow
+clock_level_t clock_floor(void)
+{
+	return holds ? CLOCK_RUN : CLOCK_IDLE;
+}
+
+// Function to add or release a hold, the clock is raised at once even if a byte is on the wire
+void clock_hold(clock_hold_t hold, bool on)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (on)
+	{
+		holds |= hold;
+		if (level < CLOCK_RUN)
+		{
+			clock_switch(CLOCK_RUN);
+		}
+	}
+	else
+	{
+		holds &= ~hold;
+	}
+	__set_PRIMASK(primask);
+}
+
+// Function to get the part of a millisecond the switches took from SysTick, it belongs after the HAL tick
+uint32_t clock_carry_us(void)
+{
+	return tick_carry_us;
+}
@@ -0,0 +1,35 @@
+// Run time system clock scaling.
+// Handlers run from a 48 MHz burst clock and the idle loop drops to 3 MHz.
+// SysTick, USART2, TIM14 and TIM16 are re-timed on every switch so tick,
+// baud rate, debounce and pattern timing do not change with the clock.
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "main.h"
+#include <stdbool.h>
+
+// Clock levels, the buses are arranged so PCLK only changes when entering or leaving idle
+typedef enum
+{
+	CLOCK_IDLE = 0,							// HSI/16, 3 MHz HCLK and PCLK
+	CLOCK_RUN,								// HSI/4, 12 MHz HCLK and PCLK, the reset configuration
+	CLOCK_FAST,								// HSI/1, 48 MHz HCLK, 12 MHz PCLK, 24 MHz timers
+	CLOCK_LEVEL_COUNT
+} clock_level_t;
+
+// Reasons that keep the clock at CLOCK_RUN or above
+typedef enum
+{
+	CLOCK_HOLD_SERVO = 0x01,				// TIM3 servo timing is only exact with a 12 MHz multiple
+} clock_hold_t;
+
+void clock_init(void);						// Capture the peripheral timings of the reset configuration
+bool clock_set(clock_level_t level);		// Switch level, refused while USART2 is busy if PCLK would change
+clock_level_t clock_get(void);				// Current level
+uint32_t clock_timer_hz(void);				// Timer clock of the current level, PCLK times two when the APB is divided
+clock_level_t clock_floor(void);			// Lowest level allowed by the holds
+void clock_hold(clock_hold_t hold, bool on);	// Add or release a hold, switches up at once, safe from ISRs
+uint32_t clock_carry_us(void);				// SysTick phase lost by the switches and not yet added to the HAL tick
+
+#endif /* CLOCK_H */
@@ -0,0 +1,53 @@
+// Program Description: N of M sampled debounce engine, independent of the HAL so it also runs on a host.
+
+#include "debounce.h"
+
+// Function to count the wet samples among the latest n
+static uint8_t debounce_count(uint32_t history, uint8_t n)
+{
+	uint32_t v = (n < 32) ? history & ((1UL << n) - 1) : history;
+	uint8_t count = 0;
+	while (v)
+	{
+		v &= v - 1;							// Clear the lowest set bit
+		count++;
+	}
+	return count;
+}
+
+// Function to clear the vote window for a new edge
+void debounce_start(debounce_t *d, const debounce_config_t *cfg)
+{
+	d->cfg = cfg;
+	d->history = 0;
+	d->taken = 0;
+}
+
+// Function to add a sample and decide whether the input is confirmed or rejected
+debounce_result_t debounce_sample(debounce_t *d, bool wet)
+{
+	const debounce_config_t *cfg = d->cfg;
+	d->history = (d->history << 1) | (wet ? 1 : 0);
+	d->taken++;
+
+	uint8_t filled = (d->taken < cfg->window) ? d->taken : cfg->window;
+	if (debounce_count(d->history, filled) >= cfg->votes)
+	{
+		return DEBOUNCE_CONFIRMED;
+	}
+	if (d->taken >= cfg->max_samples)
+	{
+		return DEBOUNCE_REJECTED;
+	}
+
+	// Best case the remaining samples are all wet, those still in the window after them count too
+	uint8_t left = cfg->max_samples - d->taken;
+	uint8_t best = (left >= cfg->window) ? cfg->window : left + debounce_count(d->history, cfg->window - left);
+	return (best >= cfg->votes) ? DEBOUNCE_PENDING : DEBOUNCE_REJECTED;
+}
+
+// Function to convert the sample interval into a TIM16 auto reload value
+uint32_t debounce_period(const debounce_config_t *cfg)
+{
+	return (uint32_t)cfg->interval_ms * DEBOUNCE_TICKS_PER_MS - 1;
+}
@@ -0,0 +1,46 @@
+// N of M sampled debounce for the flood probe inputs.
+// After an edge the probe is sampled at a fixed interval and each sample is
+// shifted into a vote window. The flood is confirmed as soon as N of the last
+// M samples are wet and rejected once that is out of reach or after K samples,
+// so a splash is ignored and the detect latency never exceeds K intervals.
+// The engine only sees sample values, the caller owns the timer and the pins.
+
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DEBOUNCE_TICKS_PER_MS	500			// TIM16 count rate, clock.c keeps it at every clock level
+#define DEBOUNCE_WINDOW_MAX		32			// Longest vote window
+
+// Debounce parameters
+typedef struct
+{
+	uint16_t interval_ms;					// Time between samples, up to 131 ms
+	uint8_t window;							// M, number of latest samples voting, 1 to DEBOUNCE_WINDOW_MAX
+	uint8_t votes;							// N, wet samples in the window that confirm, 1 to M
+	uint8_t max_samples;					// K, samples before the edge is rejected, at least N
+} debounce_config_t;
+
+// State of one debounced input
+typedef struct
+{
+	const debounce_config_t *cfg;
+	uint32_t history;						// Latest sample in bit 0, 1 is wet
+	uint8_t taken;							// Samples since the edge
+} debounce_t;
+
+// Verdict after a sample
+typedef enum
+{
+	DEBOUNCE_PENDING = 0,					// Keep sampling
+	DEBOUNCE_CONFIRMED,						// N of the last M samples were wet
+	DEBOUNCE_REJECTED,						// Confirmation out of reach, the edge was noise
+} debounce_result_t;
+
+void debounce_start(debounce_t *d, const debounce_config_t *cfg);	// Clear the window for a new edge
+debounce_result_t debounce_sample(debounce_t *d, bool wet);	// Vote with one sample
+uint32_t debounce_period(const debounce_config_t *cfg);	// TIM16 auto reload value for the sample interval
+
+#endif /* DEBOUNCE_H */
@@ -0,0 +1,100 @@
+// Program Description: Allocation free decimal, hex and fixed point formatting.
+
+#include "fmt.h"
+
+// Powers of ten used to extract digits without division, the M0+ has no divider
+static const uint32_t pow10[] =
+{
+	1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1
+};
+
+// Function to write value with at least min_digits digits, zero padded
+static char *fmt_digits(char *dst, uint32_t value, uint8_t min_digits)
+{
+	uint8_t started = 0;
+	for (uint8_t i = 0; i < 10; i++)
+	{
+		char digit = '0';
+		while (value >= pow10[i])
+		{
+			value -= pow10[i];
+			digit++;
+		}
+		if (digit != '0' || started || i >= 10 - min_digits)
+		{
+			*dst++ = digit;
+			started = 1;
+		}
+	}
+	*dst = '\0';
+	return dst;
+}
+
+// Function to copy a string
+char *fmt_str(char *dst, const char *str)
+{
+	while (*str)
+	{
+		*dst++ = *str++;
+	}
+	*dst = '\0';
+	return dst;
+}
+
+// Function to write an unsigned decimal number
+char *fmt_u32(char *dst, uint32_t value)
+{
+	return fmt_digits(dst, value, 1);
+}
+
+// Function to write a signed decimal number
+char *fmt_i32(char *dst, int32_t value)
+{
+	if (value < 0)
+	{
+		*dst++ = '-';
+		return fmt_digits(dst, 0u - (uint32_t)value, 1);
+	}
+	return fmt_digits(dst, (uint32_t)value, 1);
+}
+
+// Function to write a zero padded upper case hex number
+char *fmt_hex(char *dst, uint32_t value, uint8_t digits)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	for (int8_t shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+	{
+		*dst++ = hex[(value >> shift) & 0xF];
+	}
+	*dst = '\0';
+	return dst;
+}
+
+// Function to write a fixed point value with three decimals, value is in thousandths
+static char *fmt_milli(char *dst, uint32_t value)
+{
+	uint32_t units = 0;
+	for (uint8_t i = 0; i < 7; i++)			// pow10[i] thousandths are pow10[i + 3] units
+	{
+		while (value >= pow10[i])
+		{
+			value -= pow10[i];
+			units += pow10[i + 3];
+		}
+	}
+	dst = fmt_digits(dst, units, 1);
+	*dst++ = '.';
+	return fmt_digits(dst, value, 3);		// Remainder is below 1000
+}
+
+// Function to write millivolts as volts with three decimals
+char *fmt_mv(char *dst, uint32_t mv)
+{
+	return fmt_milli(dst, mv);
+}
+
+// Function to write milliseconds as seconds with three decimals
+char *fmt_time(char *dst, uint32_t ms)
+{
+	return fmt_milli(dst, ms);
+}
@@ -0,0 +1,17 @@
+// Small reentrant formatter used instead of newlib sprintf.
+// Every function writes at dst, null terminates and returns a pointer to the
+// terminator so calls can be chained to build a line without any state.
+
+#ifndef FMT_H
+#define FMT_H
+
+#include <stdint.h>
+
+char *fmt_str(char *dst, const char *str);	// Copy a string
+char *fmt_u32(char *dst, uint32_t value);	// Unsigned decimal
+char *fmt_i32(char *dst, int32_t value);	// Signed decimal
+char *fmt_hex(char *dst, uint32_t value, uint8_t digits);	// Upper case hex, zero padded to digits
+char *fmt_mv(char *dst, uint32_t mv);		// Millivolts as volts, e.g. 3300 -> "3.300"
+char *fmt_time(char *dst, uint32_t ms);		// Milliseconds as seconds, e.g. 61005 -> "61.005"
+
+#endif /* FMT_H */
@@ -0,0 +1,92 @@
+// Program Description: Ring buffered UART logger drained by DMA on USART2.
+
+#include "logger.h"
+#include <string.h>
+
+extern UART_HandleTypeDef huart2;    		// Declare UART handler
+
+static char ring[LOG_BUFFER_SIZE];			// Bytes waiting for transmission
+static volatile uint16_t head;				// Free running write index, owned by the writers
+static volatile uint16_t tail;				// Free running read index, owned by the DMA drain
+static volatile uint16_t tx_len;			// Length of the DMA transfer in progress
+static volatile uint32_t dropped;			// Bytes lost to a full buffer or a failed transfer start
+
+// Function to start a DMA transfer of the next contiguous block, called with interrupts masked
+static void log_kick(void)
+{
+	if (tx_len != 0 || head == tail)
+	{
+		return;
+	}
+	uint16_t start = tail & (LOG_BUFFER_SIZE - 1);
+	uint16_t len = head - tail;
+	if (len > LOG_BUFFER_SIZE - start)
+	{
+		len = LOG_BUFFER_SIZE - start;		// Stop at the end of the buffer, the rest follows
+	}
+	tx_len = len;
+	if (HAL_UART_Transmit_DMA(&huart2, (uint8_t *)&ring[start], len) != HAL_OK)
+	{
+		// Nothing will complete, drop the queued bytes so the ring and log_busy do not wait forever
+		tx_len = 0;
+		dropped += (uint16_t)(head - tail);
+		tail = head;
+	}
+}
+
+// Function to queue bytes for transmission, safe to call from the main loop and from ISRs
+uint16_t log_write(const char *data, uint16_t len)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint16_t space = LOG_BUFFER_SIZE - (uint16_t)(head - tail);
+	if (len > space)
+	{
+		dropped += len - space;
+		len = space;
+	}
+	uint16_t start = head & (LOG_BUFFER_SIZE - 1);
+	uint16_t first = (len > LOG_BUFFER_SIZE - start) ? LOG_BUFFER_SIZE - start : len;
+	memcpy(&ring[start], data, first);
+	memcpy(ring, data + first, len - first);
+	head += len;
+	log_kick();
+	__set_PRIMASK(primask);
+	return len;
+}
+
+// Function to queue a null terminated string
+void log_puts(const char *str)
+{
+	log_write(str, strlen(str));
+}
+
+// Function to get the free space in the ring buffer
+uint16_t log_space(void)
+{
+	return LOG_BUFFER_SIZE - (uint16_t)(head - tail);
+}
+
+// Function to check whether the logger still has bytes to send
+bool log_busy(void)
+{
+	// TC is only set once the last stop bit has left the shift register
+	return head != tail || __HAL_UART_GET_FLAG(&huart2, UART_FLAG_TC) == RESET;
+}
+
+// Function to get the number of bytes dropped because the buffer was full or the DMA did not start
+uint32_t log_dropped(void)
+{
+	return dropped;
+}
+
+// Callback function for the end of a UART DMA transmission
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if (huart == &huart2)
+	{
+		tail += tx_len;
+		tx_len = 0;
+		log_kick();
+	}
+}
@@ -0,0 +1,19 @@
+// Asynchronous UART logger.
+// Log lines are copied into a ring buffer and drained to USART2 by DMA, so a
+// log call costs a memcpy instead of blocking until the line is on the wire.
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "main.h"
+#include <stdbool.h>
+
+#define LOG_BUFFER_SIZE		512				// Ring buffer size, must be a power of two
+
+uint16_t log_write(const char *data, uint16_t len);	// Queue bytes, returns the number accepted
+void log_puts(const char *str);				// Queue a null terminated string
+uint16_t log_space(void);					// Free space in the ring buffer
+bool log_busy(void);						// Check whether bytes are queued or still shifting out
+uint32_t log_dropped(void);					// Bytes dropped by a full ring buffer or a failed DMA start
+
+#endif /* LOGGER_H */
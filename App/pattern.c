@@ -0,0 +1,135 @@
+// Program Description: LED and buzzer pattern engine played from the TIM14 interrupt.
+
+#include "pattern.h"
+#include "power.h"
+
+extern TIM_HandleTypeDef htim14;			// Declare Timer 14 handler
+
+// Playback state of one output
+typedef struct
+{
+	const uint16_t *segs;					// Segment durations, NULL when idle
+	uint8_t count;							// Number of segments
+	uint8_t index;							// Segment being played
+	uint16_t remaining;						// Time left in the current segment (ms)
+} pattern_channel_t;
+
+static GPIO_TypeDef *const ports[PATTERN_OUT_COUNT] = { STATUS_LED_GPIO_Port, BUZZER_GPIO_Port, WARNING_LED_GPIO_Port };
+static const uint16_t pins[PATTERN_OUT_COUNT] = { STATUS_LED_Pin, BUZZER_Pin, WARNING_LED_Pin };
+static const power_state_t loads[PATTERN_OUT_COUNT] = { POWER_STATUS_LED, POWER_BUZZER, POWER_WARNING_LED };
+static pattern_channel_t channels[PATTERN_OUT_COUNT];
+
+// Function to drive one output and account its supply current
+static void pattern_write(uint8_t out, bool on)
+{
+	HAL_GPIO_WritePin(ports[out], pins[out], on ? GPIO_PIN_SET : GPIO_PIN_RESET);
+	if (on)
+	{
+		power_begin(loads[out]);
+	}
+	else
+	{
+		power_end(loads[out]);
+	}
+}
+
+// Function to advance all channels by the elapsed time and program the next boundary
+static void pattern_advance(uint16_t elapsed)
+{
+	uint16_t next = 0xFFFF;
+	for (uint8_t i = 0; i < PATTERN_OUT_COUNT; i++)
+	{
+		pattern_channel_t *ch = &channels[i];
+		if (ch->segs == NULL)
+		{
+			continue;
+		}
+		ch->remaining = (ch->remaining > elapsed) ? ch->remaining - elapsed : 0;
+		while (ch->remaining == 0)
+		{
+			if (++ch->index >= ch->count)
+			{
+				ch->segs = NULL;
+				pattern_write(i, false);
+				break;
+			}
+			ch->remaining = ch->segs[ch->index];
+			pattern_write(i, (ch->index & 1) == 0);
+		}
+		if (ch->segs != NULL && ch->remaining < next)
+		{
+			next = ch->remaining;
+		}
+	}
+
+	if (next == 0xFFFF)
+	{
+		HAL_TIM_Base_Stop_IT(&htim14);
+	}
+	else
+	{
+		if (next < PATTERN_MIN_STEP)
+		{
+			next = PATTERN_MIN_STEP;		// ARR 0 stops TIM14, a 1 ms boundary is served 1 ms late instead
+		}
+		__HAL_TIM_SET_COUNTER(&htim14, 0);
+		__HAL_TIM_SET_AUTORELOAD(&htim14, next - 1);
+		if ((htim14.Instance->CR1 & TIM_CR1_CEN) == 0)
+		{
+			__HAL_TIM_CLEAR_FLAG(&htim14, TIM_FLAG_UPDATE);
+			HAL_TIM_Base_Start_IT(&htim14);
+		}
+	}
+}
+
+// Function to start a pattern on one output, replaces the pattern already playing there
+void pattern_play(pattern_out_t out, const uint16_t *segs, uint8_t count)
+{
+	HAL_NVIC_DisableIRQ(TIM14_IRQn);
+	uint16_t elapsed = 0;
+	if (htim14.Instance->CR1 & TIM_CR1_CEN)
+	{
+		elapsed = __HAL_TIM_GET_COUNTER(&htim14);	// Time spent in the current boundary interval
+		if (__HAL_TIM_GET_FLAG(&htim14, TIM_FLAG_UPDATE))
+		{
+			// A boundary was reached but not serviced yet
+			elapsed += __HAL_TIM_GET_AUTORELOAD(&htim14) + 1;
+			__HAL_TIM_CLEAR_FLAG(&htim14, TIM_FLAG_UPDATE);
+		}
+	}
+	channels[out].segs = segs;
+	channels[out].count = count;
+	channels[out].index = 0;
+	channels[out].remaining = segs[0] + elapsed;	// Compensated by pattern_advance
+	pattern_write(out, true);
+	pattern_advance(elapsed);
+	HAL_NVIC_EnableIRQ(TIM14_IRQn);
+}
+
+// Function to stop a pattern and switch its output off
+void pattern_stop(pattern_out_t out)
+{
+	HAL_NVIC_DisableIRQ(TIM14_IRQn);
+	channels[out].segs = NULL;
+	pattern_write(out, false);
+	HAL_NVIC_EnableIRQ(TIM14_IRQn);
+}
+
+// Function to check whether any pattern is still playing
+bool pattern_busy(void)
+{
+	for (uint8_t i = 0; i < PATTERN_OUT_COUNT; i++)
+	{
+		if (channels[i].segs != NULL)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Function to handle the TIM14 update event, one segment boundary has been reached
+void pattern_tim_update(void)
+{
+	pattern_advance(__HAL_TIM_GET_AUTORELOAD(&htim14) + 1);
+}
@@ -0,0 +1,30 @@
+// LED and buzzer pattern engine.
+// Each output plays a list of on/off segments from the TIM14 interrupt. The timer
+// fires only at segment boundaries, so callers start a pattern and return at once.
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "main.h"
+#include <stdbool.h>
+
+// Pattern outputs on GPIOB
+typedef enum
+{
+	PATTERN_OUT_LED = 0,					// PB7, status and battery LED
+	PATTERN_OUT_BUZZER,						// PB8, buzzer
+	PATTERN_OUT_WARNING,					// PB9, warning LED
+	PATTERN_OUT_COUNT
+} pattern_out_t;
+
+#define PATTERN_MIN_STEP	2				// Shortest TIM14 interval (ms), ARR must stay above 0
+
+// Segment durations in ms, alternating on and off and starting with on.
+// The output is switched off once the last segment has elapsed, a boundary
+// closer than PATTERN_MIN_STEP to the previous one is reached that much later.
+void pattern_play(pattern_out_t out, const uint16_t *segs, uint8_t count);
+void pattern_stop(pattern_out_t out);		// Stop a pattern and switch its output off
+bool pattern_busy(void);					// Check whether any pattern is still playing
+void pattern_tim_update(void);				// TIM14 update event handler
+
+#endif /* PATTERN_H */
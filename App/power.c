@@ -0,0 +1,240 @@
+// Program Description: Power state residency counters and supply current model.
+
+#include "power.h"
+#include "scheduler.h"
+
+// Residency of one state
+typedef struct
+{
+	uint64_t total_us;						// Time spent in completed intervals
+	uint64_t start_us;						// Entry timestamp of the open interval
+	uint32_t entries;						// Number of entries
+	bool active;							// Interval currently open
+} power_slot_t;
+
+static power_slot_t slots[POWER_STATE_COUNT];
+static uint64_t uptime_us;					// Time accounted up to last_us
+static uint64_t last_us;					// Last sched_now_us64() folded into uptime_us
+static uint64_t level_us[CLOCK_LEVEL_COUNT];	// Time executing at each clock level
+static clock_level_t run_level;				// Clock level since last_us
+
+// Run and delay are charged per clock level from level_us
+static const uint32_t current_ua[POWER_STATE_COUNT] =
+{
+	[POWER_SLEEP] = POWER_UA_SLEEP,
+	[POWER_STOP] = POWER_UA_STOP,
+	[POWER_DEEP_STOP] = POWER_UA_DEEP_STOP,
+	[POWER_SERVO] = POWER_UA_SERVO,
+	[POWER_BUZZER] = POWER_UA_BUZZER,
+	[POWER_STATUS_LED] = POWER_UA_LED,
+	[POWER_WARNING_LED] = POWER_UA_LED,
+	[POWER_BATT_SENSE] = POWER_UA_BATT_SENSE,
+};
+
+static const uint32_t level_ua[CLOCK_LEVEL_COUNT] =
+{
+	[CLOCK_IDLE] = POWER_UA_RUN_IDLE,
+	[CLOCK_RUN] = POWER_UA_RUN,
+	[CLOCK_FAST] = POWER_UA_RUN_FAST,
+};
+
+static const char *const names[POWER_STATE_COUNT] =
+{
+	[POWER_RUN] = "run",
+	[POWER_DELAY] = "delay",
+	[POWER_SLEEP] = "sleep",
+	[POWER_STOP] = "stop",
+	[POWER_DEEP_STOP] = "deep",
+	[POWER_SERVO] = "servo",
+	[POWER_BUZZER] = "buzzer",
+	[POWER_STATUS_LED] = "led",
+	[POWER_WARNING_LED] = "warn",
+	[POWER_BATT_SENSE] = "batt",
+};
+
+// Function to fold the elapsed time into the uptime and the executing clock level, called with interrupts masked
+static uint64_t power_now(void)
+{
+	uint64_t now = sched_now_us64();		// A STOP period can last longer than the 71 minutes of sched_now_us
+	if (now < last_us)
+	{
+		return last_us;						// Never fold a negative span, the accounted time only moves forward
+	}
+	uint64_t elapsed = now - last_us;
+	uptime_us += elapsed;
+	if (!slots[POWER_SLEEP].active && !slots[POWER_STOP].active && !slots[POWER_DEEP_STOP].active)
+	{
+		level_us[run_level] += elapsed;
+	}
+	last_us = now;
+	return now;
+}
+
+// Function to get the time spent in a state including the open interval, called with interrupts masked
+static uint64_t power_time_us(power_state_t state, uint64_t now)
+{
+	uint64_t t = slots[state].total_us;
+	if (slots[state].active)
+	{
+		t += now - slots[state].start_us;
+	}
+	return t;
+}
+
+// Function to get the run time, the executing time at all clock levels not spent in HAL_Delay
+static uint64_t power_run_us(uint64_t now)
+{
+	uint64_t executing = 0;
+	for (uint8_t i = 0; i < CLOCK_LEVEL_COUNT; i++)
+	{
+		executing += level_us[i];
+	}
+	uint64_t delay = power_time_us(POWER_DELAY, now);
+	return (executing > delay) ? executing - delay : 0;
+}
+
+// Function to reset all counters and start accounting from now
+void power_init(void)
+{
+	__disable_irq();
+	for (uint8_t i = 0; i < POWER_STATE_COUNT; i++)
+	{
+		slots[i].total_us = 0;
+		slots[i].entries = 0;
+		slots[i].active = false;
+	}
+	for (uint8_t i = 0; i < CLOCK_LEVEL_COUNT; i++)
+	{
+		level_us[i] = 0;
+	}
+	uptime_us = 0;
+	last_us = sched_now_us64();
+	run_level = clock_get();
+	__enable_irq();
+}
+
+// Function to close the executing time of the old clock level, called with interrupts masked
+void power_clock(clock_level_t level)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	power_now();
+	run_level = level;
+	__set_PRIMASK(primask);
+}
+
+// Function to get the time executing at a clock level
+uint32_t power_level_ms(clock_level_t level)
+{
+	__disable_irq();
+	power_now();
+	uint64_t t = level_us[level];
+	__enable_irq();
+	return (uint32_t)(t / 1000);
+}
+
+// Function to get the run current of the current clock level
+uint32_t power_run_ua(void)
+{
+	return level_ua[run_level];
+}
+
+// Function to open an interval for a state
+void power_begin(power_state_t state)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (!slots[state].active)
+	{
+		slots[state].start_us = power_now();
+		slots[state].entries++;
+		slots[state].active = true;
+	}
+	__set_PRIMASK(primask);
+}
+
+// Function to close the interval of a state
+void power_end(power_state_t state)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (slots[state].active)
+	{
+		slots[state].total_us += power_now() - slots[state].start_us;
+		slots[state].active = false;
+	}
+	__set_PRIMASK(primask);
+}
+
+// Function to get the total time spent in a state
+uint32_t power_time_ms(power_state_t state)
+{
+	__disable_irq();
+	uint64_t now = power_now();
+	uint64_t t = (state == POWER_RUN) ? power_run_us(now) : power_time_us(state, now);
+	__enable_irq();
+	return (uint32_t)(t / 1000);
+}
+
+// Function to get the number of times a state was entered
+uint32_t power_entries(power_state_t state)
+{
+	if (state == POWER_RUN)
+	{
+		return slots[POWER_SLEEP].entries + slots[POWER_STOP].entries + slots[POWER_DEEP_STOP].entries + 1;	// Every wake up starts a run interval
+	}
+	return slots[state].entries;
+}
+
+// Function to get the time since power_init
+uint32_t power_uptime_ms(void)
+{
+	__disable_irq();
+	power_now();
+	uint64_t t = uptime_us;
+	__enable_irq();
+	return (uint32_t)(t / 1000);
+}
+
+// Function to get the average supply current weighted by the residency of every state
+uint32_t power_avg_ua(void)
+{
+	uint64_t charge = 0;					// uA x ms, the ms resolution keeps a year of servo time in range
+	__disable_irq();
+	uint64_t now = power_now();
+	uint64_t uptime = uptime_us;
+	for (uint8_t i = 0; i < CLOCK_LEVEL_COUNT; i++)
+	{
+		charge += level_ua[i] * (level_us[i] / 1000);	// Run and delay
+	}
+	for (uint8_t i = POWER_SLEEP; i < POWER_STATE_COUNT; i++)
+	{
+		charge += current_ua[i] * (power_time_us((power_state_t)i, now) / 1000);
+	}
+	__enable_irq();
+	uptime /= 1000;
+	return uptime ? (uint32_t)(charge / uptime) : 0;
+}
+
+// Function to get the short name of a state
+const char *power_name(power_state_t state)
+{
+	return (state < POWER_STATE_COUNT) ? names[state] : "?";
+}
+
+// Function to wait for a number of milliseconds, replaces the weak HAL version to account the busy wait
+void HAL_Delay(uint32_t Delay)
+{
+	uint32_t tickstart = HAL_GetTick();
+	uint32_t wait = Delay;
+
+	if (wait < HAL_MAX_DELAY)
+	{
+		wait += (uint32_t)(uwTickFreq);			// Guarantee the minimum wait like the HAL version
+	}
+	power_begin(POWER_DELAY);
+	while ((HAL_GetTick() - tickstart) < wait)
+	{
+	}
+	power_end(POWER_DELAY);
+}
@@ -0,0 +1,82 @@
+// Power state residency accounting and energy model.
+// The core states (delay, sleep, both STOP profiles) are timed from the scheduler and the
+// HAL_Delay override, run is whatever remains. The time the core executes is
+// also split by clock level, each level is charged its own run current. Loads
+// (servo, buzzer, LEDs) overlap the core states and are timed from the code
+// that switches them.
+
+#ifndef POWER_H
+#define POWER_H
+
+#include "main.h"
+#include "clock.h"
+#include <stdbool.h>
+
+#ifndef POWER_SUPPLY_MV
+#define POWER_SUPPLY_MV		3300			// Supply voltage used to turn charge into energy
+#endif
+
+// Supply current per state in uA, override from the build flags for a board revision
+#ifndef POWER_UA_RUN_IDLE
+#define POWER_UA_RUN_IDLE	500				// Core running at 3 MHz from flash
+#endif
+#ifndef POWER_UA_RUN
+#define POWER_UA_RUN		1500			// Core running at 12 MHz from flash
+#endif
+#ifndef POWER_UA_RUN_FAST
+#define POWER_UA_RUN_FAST	5000			// Core running at 48 MHz from flash with one wait state
+#endif
+#ifndef POWER_UA_SLEEP
+#define POWER_UA_SLEEP		600				// Core in SLEEP between SysTick interrupts
+#endif
+#ifndef POWER_UA_STOP
+#define POWER_UA_STOP		80				// STOP with the main regulator on and the RTC running
+#endif
+#ifndef POWER_UA_DEEP_STOP
+#define POWER_UA_DEEP_STOP	45				// STOP with the flash powered down
+#endif
+#ifndef POWER_UA_SERVO
+#define POWER_UA_SERVO		250000			// Servo powered from PA9 and driven by TIM3
+#endif
+#ifndef POWER_UA_BUZZER
+#define POWER_UA_BUZZER		20000			// Buzzer on PB8
+#endif
+#ifndef POWER_UA_BATT_SENSE
+#define POWER_UA_BATT_SENSE	150				// Battery divider switched on by PB15
+#endif
+#ifndef POWER_UA_ADC
+#define POWER_UA_ADC		250				// ADC converting, it powers off by itself in between
+#endif
+#ifndef POWER_UA_LED
+#define POWER_UA_LED		5000			// One indicator LED
+#endif
+
+// Accounted power states
+typedef enum
+{
+	POWER_RUN = 0,							// Core running, derived from the other core states
+	POWER_DELAY,							// Busy waiting in HAL_Delay
+	POWER_SLEEP,							// SLEEP mode in the scheduler idle loop
+	POWER_STOP,								// STOP mode
+	POWER_DEEP_STOP,						// STOP mode with the flash powered down
+	POWER_SERVO,							// Servo power enabled
+	POWER_BUZZER,							// Buzzer on
+	POWER_STATUS_LED,						// Status LED on
+	POWER_WARNING_LED,						// Warning LED on
+	POWER_BATT_SENSE,						// Battery divider powered
+	POWER_STATE_COUNT
+} power_state_t;
+
+void power_init(void);						// Start accounting from now
+void power_begin(power_state_t state);		// Enter a state, ignored if already active, safe from ISRs
+void power_end(power_state_t state);		// Leave a state, ignored if not active, safe from ISRs
+uint32_t power_time_ms(power_state_t state);	// Total time spent in a state
+uint32_t power_entries(power_state_t state);	// Number of times a state was entered
+uint32_t power_uptime_ms(void);				// Time since power_init
+uint32_t power_avg_ua(void);				// Average supply current from the current model
+void power_clock(clock_level_t level);		// Switch the run current to a new clock level, called by clock.c
+uint32_t power_level_ms(clock_level_t level);	// Time executing, run or delay, at a clock level
+uint32_t power_run_ua(void);				// Run current of the current clock level
+const char *power_name(power_state_t state);	// Short name of a state
+
+#endif /* POWER_H */
@@ -0,0 +1,280 @@
+// Program Description: Flood probes on EXTI lines, debounced together on the TIM16 sample clock.
+
+#include "probe.h"
+#include "trace.h"
+#include "scheduler.h"
+
+extern TIM_HandleTypeDef htim16;			// Declare Timer 16 handler
+
+// Probe pin, active low with the internal pull-up
+typedef struct
+{
+	GPIO_TypeDef *port;
+	uint16_t pin;							// One EXTI line, not shared with another probe
+	const char *name;
+} probe_def_t;
+
+// Installed probes, one per guarded appliance
+static const probe_def_t probes[] =
+{
+	{ FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, "PB6" },
+	{ FLOOD_SENSOR2_GPIO_Port, FLOOD_SENSOR2_Pin, "PC13" },
+};
+
+#define PROBE_COUNT			(sizeof(probes) / sizeof(probes[0]))
+
+_Static_assert(PROBE_COUNT <= PROBE_MAX, "Too many probes for the flag masks");
+
+static const debounce_config_t config = { FLOOD_SAMPLE_MS, FLOOD_WINDOW, FLOOD_VOTES, FLOOD_MAX_SAMPLES };
+static debounce_t windows[PROBE_COUNT];		// Vote window of each probe
+static probe_stats_t stats[PROBE_COUNT];
+static volatile uint8_t sampling;			// Probes with an open debounce window
+static volatile uint8_t flooded;			// Probes with a confirmed flood
+static probe_cb_t event_cb;
+static uint32_t test_us;					// Duration of the last self-test
+
+static const char *const health_names[] = { "untested", "ok", "stuck high", "stuck low" };
+
+// Function to configure every probe pin as a falling edge interrupt and enable its EXTI group
+void probe_init(probe_cb_t cb)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+	event_cb = cb;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+	GPIO_InitStruct.Pull = GPIO_PULLUP;
+	for (uint8_t i = 0; i < PROBE_COUNT; i++)
+	{
+		GPIO_InitStruct.Pin = probes[i].pin;
+		HAL_GPIO_Init(probes[i].port, &GPIO_InitStruct);
+		IRQn_Type irq = (probes[i].pin <= GPIO_PIN_1) ? EXTI0_1_IRQn : (probes[i].pin <= GPIO_PIN_3) ? EXTI2_3_IRQn : EXTI4_15_IRQn;
+		HAL_NVIC_SetPriority(irq, 0, 0);
+		HAL_NVIC_EnableIRQ(irq);
+	}
+}
+
+// Function to count an edge and open the debounce window of its probe, the window starts before any bookkeeping
+static void probe_edge(uint8_t i)
+{
+	uint8_t bit = 1 << i;
+	bool opened = !(sampling & bit);		// Later edges of the same window are sampled by the running debounce
+	if (opened)
+	{
+		debounce_start(&windows[i], &config);
+		sampling |= bit;
+		if (htim16.State == HAL_TIM_STATE_READY)
+		{
+			__HAL_TIM_SET_AUTORELOAD(&htim16, debounce_period(&config));
+			__HAL_TIM_SET_COUNTER(&htim16, 0);
+			HAL_TIM_Base_Start_IT(&htim16);
+		}
+	}
+	stats[i].edges++;
+	trace_record(TRACE_FLOOD_EDGE, i);
+	event_cb(i, PROBE_EDGE);
+	if (opened)
+	{
+		trace_record(TRACE_DEBOUNCE_START, i);
+		event_cb(i, PROBE_START);
+	}
+}
+
+// Function to handle the pending edges of all probes, lines of other EXTI groups are never pending here
+void probe_irq(void)
+{
+	for (uint8_t i = 0; i < PROBE_COUNT; i++)
+	{
+		if (__HAL_GPIO_EXTI_GET_FALLING_IT(probes[i].pin))
+		{
+			__HAL_GPIO_EXTI_CLEAR_FALLING_IT(probes[i].pin);
+			probe_edge(i);
+		}
+	}
+}
+
+// Function to sample every probe with an open window and report the verdicts
+void probe_tim_update(void)
+{
+	for (uint8_t i = 0; i < PROBE_COUNT; i++)
+	{
+		uint8_t bit = 1 << i;
+		if (!(sampling & bit))
+		{
+			continue;
+		}
+		debounce_result_t verdict = debounce_sample(&windows[i], probe_wet(i));
+		if (verdict == DEBOUNCE_PENDING)
+		{
+			continue;
+		}
+		sampling &= ~bit;
+		bool confirmed = (verdict == DEBOUNCE_CONFIRMED);
+		trace_record(TRACE_FLOOD_CONFIRM, (confirmed ? 0x8000 : 0) | (i << 8) | windows[i].taken);
+		if (confirmed)
+		{
+			flooded |= bit;
+			stats[i].floods++;
+		}
+		else
+		{
+			stats[i].rejects++;
+		}
+		event_cb(i, confirmed ? PROBE_CONFIRMED : PROBE_REJECTED);
+	}
+	if (!sampling)
+	{
+		HAL_TIM_Base_Stop_IT(&htim16);
+	}
+}
+
+// Function to get the number of configured probes
+uint8_t probe_count(void)
+{
+	return PROBE_COUNT;
+}
+
+// Function to get the short name of a probe
+const char *probe_name(uint8_t probe)
+{
+	return (probe < PROBE_COUNT) ? probes[probe].name : "?";
+}
+
+// Function to read the current level of a probe
+bool probe_wet(uint8_t probe)
+{
+	return HAL_GPIO_ReadPin(probes[probe].port, probes[probe].pin) == GPIO_PIN_RESET;
+}
+
+// Function to check whether any probe is wet now
+bool probe_any_wet(void)
+{
+	for (uint8_t i = 0; i < PROBE_COUNT; i++)
+	{
+		if (probe_wet(i))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Function to get the flood flag of a probe
+bool probe_flooded(uint8_t probe)
+{
+	return (flooded >> probe) & 1;
+}
+
+// Function to check whether any probe has an open debounce window
+bool probe_busy(void)
+{
+	return sampling != 0;
+}
+
+// Function to clear the flood flags once the user has reset the flood
+void probe_clear(void)
+{
+	flooded = 0;
+}
+
+// Function to wait for a number of microseconds
+static void probe_wait_us(uint32_t us)
+{
+	uint32_t start = sched_now_us();
+	while ((sched_now_us() - start) < us)
+	{
+	}
+}
+
+// Function to change the mode and pull of a probe pin
+static void probe_set_pin(const probe_def_t *p, uint32_t mode, uint32_t pull)
+{
+	uint8_t pos = 0;
+	while (!((p->pin >> pos) & 1))
+	{
+		pos++;
+	}
+	MODIFY_REG(p->port->PUPDR, GPIO_PUPDR_PUPD0 << (pos * 2), pull << (pos * 2));
+	MODIFY_REG(p->port->MODER, GPIO_MODER_MODE0 << (pos * 2), mode << (pos * 2));
+}
+
+// Function to check that a probe pin follows the pull-down and the drive, its EXTI line is masked meanwhile
+static probe_health_t probe_test(const probe_def_t *p)
+{
+	CLEAR_BIT(EXTI->IMR1, p->pin);
+
+	// A dry or wet probe follows the pull-down, only a short to the supply keeps the pin high
+	probe_set_pin(p, 0, GPIO_PULLDOWN);
+	probe_wait_us(PROBE_SETTLE_US);
+	bool high = HAL_GPIO_ReadPin(p->port, p->pin) == GPIO_PIN_SET;
+
+	// Water cannot hold a driven pin low, only a short to ground can
+	p->port->BSRR = p->pin;
+	probe_set_pin(p, 1, GPIO_NOPULL);
+	probe_wait_us(PROBE_DRIVE_US);
+	bool low = HAL_GPIO_ReadPin(p->port, p->pin) == GPIO_PIN_RESET;
+	probe_set_pin(p, 0, GPIO_PULLUP);
+	p->port->BRR = p->pin;
+	probe_wait_us(PROBE_SETTLE_US);
+
+	__HAL_GPIO_EXTI_CLEAR_FALLING_IT(p->pin);	// Drop the edge made by the pull-down
+	SET_BIT(EXTI->IMR1, p->pin);
+	return high ? PROBE_HEALTH_STUCK_HIGH : low ? PROBE_HEALTH_STUCK_LOW : PROBE_HEALTH_OK;
+}
+
+// Function to self-test every probe without an open debounce window
+uint8_t probe_selftest(void)
+{
+	uint8_t faults = 0;
+	uint32_t start = sched_now_us();
+	for (uint8_t i = 0; i < PROBE_COUNT; i++)
+	{
+		uint8_t bit = 1 << i;
+		if (sampling & bit)
+		{
+			stats[i].health = PROBE_HEALTH_UNKNOWN;
+			continue;
+		}
+		probe_health_t health = probe_test(&probes[i]);
+		stats[i].tests++;
+		stats[i].health = health;
+		if (health == PROBE_HEALTH_STUCK_HIGH)
+		{
+			stats[i].stuck_high++;
+		}
+		else if (health == PROBE_HEALTH_STUCK_LOW)
+		{
+			stats[i].stuck_low++;
+		}
+		if (health != PROBE_HEALTH_OK)
+		{
+			faults |= bit;
+		}
+
+		// An edge masked by the test is replayed so a flood starting meanwhile is not lost
+		__disable_irq();
+		if (probe_wet(i) && !(sampling & bit) && !(flooded & bit))
+		{
+			probe_edge(i);
+		}
+		__enable_irq();
+	}
+	test_us = sched_now_us() - start;
+	return faults;
+}
+
+// Function to get the duration of the last self-test
+uint32_t probe_test_us(void)
+{
+	return test_us;
+}
+
+// Function to get the short name of a self-test verdict
+const char *probe_health_name(probe_health_t health)
+{
+	return (health <= PROBE_HEALTH_STUCK_LOW) ? health_names[health] : "?";
+}
+
+// Function to get the counters of a probe
+const probe_stats_t *probe_stats(uint8_t probe)
+{
+	return &stats[probe];
+}
@@ -0,0 +1,85 @@
+// Table driven flood probe inputs.
+// Every probe is an EXTI falling edge pin with its own debounce window, flood
+// flag and counters. The EXTI handlers service all probe lines of their group
+// through one routine and a single TIM16 sample clock votes every probe whose
+// window is open, so adding a probe is one table entry in probe.c.
+// A self-test briefly pulls each pin down and drives it high to find probes
+// shorted to the supply or to ground, the fault states water cannot mimic.
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "main.h"
+#include "debounce.h"
+#include <stdbool.h>
+
+// Debounce shared by the probes, N of the last M samples taken every interval must be wet within K samples
+#ifndef FLOOD_SAMPLE_MS
+#define FLOOD_SAMPLE_MS		10				// Interval between probe samples (ms)
+#endif
+#ifndef FLOOD_WINDOW
+#define FLOOD_WINDOW		8				// M, latest samples voting
+#endif
+#ifndef FLOOD_VOTES
+#define FLOOD_VOTES			6				// N, wet samples confirming a flood
+#endif
+#ifndef FLOOD_MAX_SAMPLES
+#define FLOOD_MAX_SAMPLES	10				// K, samples before an edge is dismissed as splash
+#endif
+#if FLOOD_VOTES > FLOOD_WINDOW || FLOOD_WINDOW > DEBOUNCE_WINDOW_MAX || FLOOD_MAX_SAMPLES < FLOOD_VOTES \
+	|| FLOOD_SAMPLE_MS * DEBOUNCE_TICKS_PER_MS > 65536
+#error "Flood debounce needs N <= M <= 32, K >= N and an interval TIM16 can count"
+#endif
+
+#define PROBE_MAX			8				// Probes that fit the flag masks
+#define PROBE_SETTLE_US		50				// Pull change settling time, covers a long probe cable
+#define PROBE_DRIVE_US		5				// Push-pull high pulse, short enough for a shorted pin
+
+// Probe events, reported from interrupt context
+typedef enum
+{
+	PROBE_EDGE = 0,							// Falling edge on the probe pin
+	PROBE_START,							// Edge opened a debounce window
+	PROBE_CONFIRMED,						// Flood confirmed, the probe flag is set
+	PROBE_REJECTED,							// Window closed without a flood
+} probe_event_t;
+
+// Counters of one probe
+typedef struct
+{
+	uint32_t edges;							// Falling edges
+	uint32_t floods;						// Confirmed floods
+	uint32_t rejects;						// Edges dismissed by the debounce
+	uint32_t tests;							// Self-tests run
+	uint32_t stuck_high;					// Self-tests that found the pin shorted to the supply
+	uint32_t stuck_low;						// Self-tests that found the pin shorted to ground
+	uint8_t health;							// probe_health_t of the last self-test
+} probe_stats_t;
+
+// Self-test verdict
+typedef enum
+{
+	PROBE_HEALTH_UNKNOWN = 0,				// Not tested yet, or skipped while debouncing
+	PROBE_HEALTH_OK,						// Pin follows both the pull-down and the drive
+	PROBE_HEALTH_STUCK_HIGH,				// Stays high with the pull-down
+	PROBE_HEALTH_STUCK_LOW,					// Stays low while driven high
+} probe_health_t;
+
+typedef void (*probe_cb_t)(uint8_t probe, probe_event_t evt);
+
+void probe_init(probe_cb_t cb);				// Configure the probe pins and their EXTI interrupts
+void probe_irq(void);						// Service the pending probe edges, called from the EXTI handlers
+void probe_tim_update(void);				// TIM16 sample clock handler
+uint8_t probe_count(void);					// Number of configured probes
+const char *probe_name(uint8_t probe);		// Short name of a probe
+bool probe_wet(uint8_t probe);				// Current level of a probe, true when wet
+bool probe_any_wet(void);					// Check whether any probe is wet now
+bool probe_flooded(uint8_t probe);			// Flood flag of a probe
+bool probe_busy(void);						// Check whether a debounce window is open, TIM16 stops in STOP mode
+void probe_clear(void);						// Clear the flood flags of all probes
+const probe_stats_t *probe_stats(uint8_t probe);	// Counters of a probe
+uint8_t probe_selftest(void);				// Test every idle probe, returns the mask of faulty probes
+uint32_t probe_test_us(void);				// Duration of the last self-test
+const char *probe_health_name(probe_health_t health);	// Short name of a self-test verdict
+
+#endif /* PROBE_H */
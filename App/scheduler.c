@@ -0,0 +1,268 @@
+// Program Description: Cooperative run-to-completion scheduler used by app_main.
+
+#include "scheduler.h"
+#include "timebase.h"
+#include "trace.h"
+#include "power.h"
+#include "clock.h"
+#include <string.h>
+
+#define SCHED_QUEUE_SIZE	16				// Event queue depth, must be a power of two
+
+// Software timer slot
+typedef struct
+{
+	uint32_t deadline;						// Tick at which the timer expires
+	sched_event_t evt;						// Event posted on expiry
+	bool active;							// Timer is armed
+} sched_timer_slot_t;
+
+static volatile uint8_t queue[SCHED_QUEUE_SIZE];	// Pending events
+static volatile uint8_t q_head;				// Next slot written by sched_post
+static volatile uint8_t q_tail;				// Next slot read by the dispatcher
+static sched_timer_slot_t timers[TMR_COUNT];	// Software timers
+static volatile bool stop_requested;		// STOP mode requested by the application
+static sched_stats_t stats[EVT_COUNT];		// Awake time per event type
+static sched_sleep_t sleep_profile;			// STOP variant entered on request
+
+// Function to reset the scheduler state
+void sched_init(void)
+{
+	q_head = 0;
+	q_tail = 0;
+	stop_requested = false;
+	sleep_profile = SCHED_SLEEP_STOP;
+	memset(timers, 0, sizeof(timers));
+	memset(stats, 0, sizeof(stats));
+}
+
+// Function to queue an event, returns false when the queue is full
+bool sched_post(sched_event_t evt)
+{
+	bool posted = false;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if ((uint8_t)(q_head - q_tail) < SCHED_QUEUE_SIZE)
+	{
+		queue[q_head & (SCHED_QUEUE_SIZE - 1)] = evt;
+		q_head++;
+		posted = true;
+	}
+	stop_requested = false;					// Any new work cancels a pending STOP request
+	__set_PRIMASK(primask);
+	return posted;
+}
+
+// Function to take the oldest event from the queue
+static sched_event_t sched_get(void)
+{
+	sched_event_t evt = EVT_NONE;
+	__disable_irq();
+	if (q_head != q_tail)
+	{
+		evt = (sched_event_t)queue[q_tail & (SCHED_QUEUE_SIZE - 1)];
+		q_tail++;
+	}
+	__enable_irq();
+	return evt;
+}
+
+// Function to arm a timer that posts evt after delay milliseconds
+void sched_timer_start(sched_timer_t tmr, uint32_t delay, sched_event_t evt)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	timers[tmr].deadline = HAL_GetTick() + delay;
+	timers[tmr].evt = evt;
+	timers[tmr].active = true;
+	stop_requested = false;					// Pending work, e.g. an edge arriving just before STOP
+	__set_PRIMASK(primask);
+}
+
+// Function to cancel a timer
+void sched_timer_stop(sched_timer_t tmr)
+{
+	timers[tmr].active = false;
+}
+
+// Function to check whether a timer is armed
+bool sched_timer_active(sched_timer_t tmr)
+{
+	return timers[tmr].active;
+}
+
+// Function to request STOP mode once all queued events are handled
+void sched_request_stop(void)
+{
+	stop_requested = true;
+}
+
+// Function to select the STOP variant, the flash power down bit only affects STOP
+void sched_set_sleep(sched_sleep_t profile)
+{
+	sleep_profile = profile;
+	if (profile == SCHED_SLEEP_DEEP)
+	{
+		HAL_PWREx_EnableFlashPowerDown(PWR_FLASHPD_STOP);
+	}
+	else
+	{
+		HAL_PWREx_DisableFlashPowerDown(PWR_FLASHPD_STOP);
+	}
+}
+
+// Function to get the selected STOP variant
+sched_sleep_t sched_get_sleep(void)
+{
+	return sleep_profile;
+}
+
+// Function to post the events of all expired timers
+static void sched_poll_timers(void)
+{
+	uint32_t now = HAL_GetTick();
+	for (uint8_t i = 0; i < TMR_COUNT; i++)
+	{
+		__disable_irq();
+		bool expired = timers[i].active && (int32_t)(now - timers[i].deadline) >= 0;
+		if (expired)
+		{
+			timers[i].active = false;
+		}
+		__enable_irq();
+		if (expired)
+		{
+			sched_post(timers[i].evt);
+		}
+	}
+}
+
+// Function to check whether a software timer is armed, nothing would wake the core at its deadline in STOP
+static bool sched_timers_armed(void)
+{
+	for (uint8_t i = 0; i < TMR_COUNT; i++)
+	{
+		if (timers[i].active)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Function to sleep until the next interrupt when there is no pending work
+static void sched_idle(void)
+{
+	// Interrupts are masked so an event posted between the check and WFI still wakes the core
+	__disable_irq();
+	if (q_head == q_tail)
+	{
+		clock_set(CLOCK_IDLE);				// Waits at the floor level, stays higher while USART2 drains
+		if (stop_requested && sched_timers_armed())
+		{
+			stop_requested = false;			// An interrupt armed a timer after the request, the request is stale
+		}
+		if (stop_requested)
+		{
+			stop_requested = false;
+			power_state_t state = (sleep_profile == SCHED_SLEEP_DEEP) ? POWER_DEEP_STOP : POWER_STOP;
+			trace_record(TRACE_STOP_ENTER, sleep_profile);
+			power_begin(state);
+			tb_stop_enter();
+			HAL_PWR_EnterSTOPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);	// Enable Stop mode
+			tb_stop_wake();
+			clock_set(CLOCK_FAST);			// The wake handler and the tick restore run at full speed
+			tb_stop_exit();					// Timers keep their wall-clock deadlines across STOP
+			power_end(state);
+			trace_record(TRACE_STOP_EXIT, sleep_profile);
+		}
+		else
+		{
+			power_begin(POWER_SLEEP);
+			HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);	// SysTick wakes the core for timers
+			power_end(POWER_SLEEP);
+		}
+	}
+	__enable_irq();
+}
+
+// Function to dispatch events forever
+void sched_run(sched_dispatch_t dispatch)
+{
+	while (1)
+	{
+		sched_poll_timers();
+		sched_event_t evt;
+		while ((evt = sched_get()) != EVT_NONE)
+		{
+			clock_set(CLOCK_FAST);			// Handlers run as a short burst at full speed
+			uint32_t start = sched_now_us();
+			dispatch(evt);
+			uint32_t busy = sched_now_us() - start;
+			stats[evt].count++;
+			stats[evt].busy_us += busy;
+			if (busy > stats[evt].max_us)
+			{
+				stats[evt].max_us = busy;
+			}
+		}
+		sched_idle();
+	}
+}
+
+// Function to read the HAL tick and the microseconds elapsed since, up to 3 ms with a pending tick and the carry
+static uint32_t sched_read_tick(uint32_t *us)
+{
+	uint32_t ms;
+	uint32_t carry;
+	uint32_t val;
+	bool pending;
+	do
+	{
+		ms = HAL_GetTick();
+		carry = clock_carry_us();
+		val = SysTick->VAL;
+		// With interrupts masked or from a higher priority ISR the counter reloads but HAL_IncTick waits
+		pending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+		if (pending)
+		{
+			val = SysTick->VAL;				// Read again, the first read may predate the reload
+		}
+	} while (ms != HAL_GetTick() || carry != clock_carry_us());	// Retry if the tick or a clock switch moved meanwhile
+	uint32_t load = SysTick->LOAD + 1;
+	*us = (pending ? 1000 : 0) + carry + ((load - val) * 1000) / load;
+	return ms;
+}
+
+// Function to read a microsecond timestamp from the HAL tick and the SysTick counter
+uint32_t sched_now_us(void)
+{
+	uint32_t us;
+	uint32_t ms = sched_read_tick(&us);
+	return ms * 1000 + us;
+}
+
+// Function to read a microsecond timestamp that does not wrap, the HAL tick wraps after 49 days
+uint64_t sched_now_us64(void)
+{
+	static uint32_t last_ms;				// Tick of the previous call
+	static uint32_t wraps;					// HAL tick wraps seen so far
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t us;
+	uint32_t ms = sched_read_tick(&us);
+	if (ms < last_ms)
+	{
+		wraps++;							// Seen as long as a call comes every 49 days, the RTC alarm wakes daily
+	}
+	last_ms = ms;
+	uint64_t now = ((((uint64_t)wraps) << 32) + ms) * 1000 + us;
+	__set_PRIMASK(primask);
+	return now;
+}
+
+// Function to get the awake time statistics of one event type
+const sched_stats_t *sched_stats(sched_event_t evt)
+{
+	return &stats[evt];
+}
@@ -0,0 +1,69 @@
+// Cooperative run-to-completion scheduler for the flood guard application.
+// ISRs post events, software timers post events when their deadline expires,
+// and the core sleeps whenever there is nothing left to dispatch.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "main.h"
+#include <stdbool.h>
+
+// Events dispatched to the application, posted from ISRs or expired timers
+typedef enum
+{
+	EVT_NONE = 0,
+	EVT_FLOOD,								// Flood confirmed by the TIM16 debounce
+	EVT_BUTTON_RELEASE,						// Button released, press duration is valid
+	EVT_ALERT_TIMER,						// Flood alert repeat deadline reached
+	EVT_SLEEP_TIMER,						// Idle timeout before entering STOP mode
+	EVT_VALVE_DONE,							// Valve motion completed
+	EVT_STOP_READY,							// Sleep indication done, enter STOP when idle
+	EVT_TEST_STEP,							// Next step of the test mode sequence
+	EVT_UART_CMD,							// Command byte received on USART2
+	EVT_TRACE_DUMP,							// Continue dumping the trace ring
+	EVT_WAKE_JOBS,							// RTC alarm, run the due periodic jobs
+	EVT_COUNT
+} sched_event_t;
+
+// Software timers, each one owns a single deadline
+typedef enum
+{
+	TMR_ALERT = 0,							// Flood alert repeat
+	TMR_SLEEP,								// Idle timeout
+	TMR_TEST,								// Test mode sequence
+	TMR_DUMP,								// Trace dump waiting for logger space
+	TMR_COUNT
+} sched_timer_t;
+
+// STOP mode variants used when the application requests STOP
+typedef enum
+{
+	SCHED_SLEEP_STOP = 0,					// STOP with the flash on, fastest wake up
+	SCHED_SLEEP_DEEP,						// STOP with the flash powered down, lower current
+	SCHED_SLEEP_COUNT
+} sched_sleep_t;
+
+// Awake time accounting for one event type
+typedef struct
+{
+	uint32_t count;							// Number of times the event was dispatched
+	uint32_t busy_us;						// Total time spent in the handler
+	uint32_t max_us;						// Longest single dispatch
+} sched_stats_t;
+
+typedef void (*sched_dispatch_t)(sched_event_t evt);
+
+void sched_init(void);						// Clear the event queue, timers and statistics
+bool sched_post(sched_event_t evt);			// Queue an event, safe to call from any ISR
+void sched_timer_start(sched_timer_t tmr, uint32_t delay, sched_event_t evt);	// Post evt after delay ms
+void sched_timer_stop(sched_timer_t tmr);	// Cancel a pending timer
+bool sched_timer_active(sched_timer_t tmr);	// Check whether a timer is still pending
+void sched_request_stop(void);				// Enter STOP mode once the queue is empty
+void sched_set_sleep(sched_sleep_t profile);	// Select the STOP variant
+sched_sleep_t sched_get_sleep(void);		// Get the selected STOP variant
+void sched_run(sched_dispatch_t dispatch);	// Dispatch events forever, never returns
+uint32_t sched_now_us(void);				// Microsecond timestamp derived from SysTick, wraps after 71 minutes
+uint64_t sched_now_us64(void);				// Microsecond timestamp that does not wrap, for spans across long STOP periods
+const sched_stats_t *sched_stats(sched_event_t evt);	// Awake time statistics for one event
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,110 @@
+// Program Description: Battery state of charge and days remaining estimate.
+
+#include "soc.h"
+#include "backup.h"
+#include "power.h"
+
+// Point of the discharge curve
+typedef struct
+{
+	uint16_t mv;							// Pack voltage at light load
+	uint16_t permille;						// Remaining charge
+} soc_point_t;
+
+// 4 x AA alkaline at a few mA, ordered from full to empty
+static const soc_point_t curve[] =
+{
+	{ 6400, 1000 },
+	{ 6080, 900 },
+	{ 5840, 800 },
+	{ 5640, 700 },
+	{ 5480, 600 },
+	{ 5320, 500 },
+	{ 5160, 400 },
+	{ 5000, 300 },
+	{ 4840, 200 },
+	{ 4640, 100 },
+	{ 4400, 50 },
+	{ 4000, 0 },
+};
+
+#define SOC_POINTS			(sizeof(curve) / sizeof(curve[0]))
+
+static uint16_t ema;						// Smoothed voltage in mV << SOC_EMA_SHIFT, 0 before the first reading
+static soc_status_t status;
+
+// Function to interpolate the discharge curve
+uint16_t soc_permille(uint16_t mv)
+{
+	if (mv >= curve[0].mv)
+	{
+		return curve[0].permille;
+	}
+	for (uint8_t i = 1; i < SOC_POINTS; i++)
+	{
+		if (mv >= curve[i].mv)
+		{
+			const soc_point_t *hi = &curve[i - 1];
+			const soc_point_t *lo = &curve[i];
+			return lo->permille + (uint32_t)(mv - lo->mv) * (hi->permille - lo->permille) / (hi->mv - lo->mv);
+		}
+	}
+	return 0;
+}
+
+// Function to derive the charge, slope and days remaining from the averages
+static void soc_estimate(void)
+{
+	status.mv = ema >> SOC_EMA_SHIFT;
+	status.permille = soc_permille(status.mv);
+	// uAh per day over the capacity in mAh gives thousandths, times 1000 for millionths
+	status.slope_ppm = (uint32_t)status.load_ua * 24 * 1000 / SOC_CAPACITY_MAH;
+	uint16_t cutoff = soc_permille(SOC_CUTOFF_MV);
+	status.days = (status.slope_ppm && status.permille > cutoff) ?
+			(uint32_t)(status.permille - cutoff) * 1000 / status.slope_ppm : 0;
+}
+
+// Function to restore the averages kept across a reset, both are 0 after a power on
+void soc_init(void)
+{
+	ema = backup_read(BACKUP_WORD_SOC_EMA);
+	status.load_ua = backup_read(BACKUP_WORD_SOC_LOAD);
+	soc_estimate();
+}
+
+// Function to add a battery reading and the current energy model average
+void soc_update(uint16_t mv)
+{
+	if (ema == 0)
+	{
+		ema = mv << SOC_EMA_SHIFT;			// First reading after a battery change seeds the average
+	}
+	else
+	{
+		ema += (int32_t)mv - (ema >> SOC_EMA_SHIFT);
+	}
+
+	uint32_t avg = power_avg_ua();
+	if (avg > UINT16_MAX)
+	{
+		avg = UINT16_MAX;
+	}
+	if (status.load_ua == 0)
+	{
+		status.load_ua = avg;
+	}
+	else
+	{
+		status.load_ua += ((int32_t)avg - status.load_ua) >> SOC_LOAD_SHIFT;
+	}
+
+	backup_write(BACKUP_WORD_SOC_EMA, ema);
+	backup_write(BACKUP_WORD_SOC_LOAD, status.load_ua);
+	soc_estimate();
+}
+
+// Function to get the latest estimate
+const soc_status_t *soc_status(void)
+{
+	return &status;
+}
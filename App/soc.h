@@ -0,0 +1,38 @@
+// Battery state of charge and days remaining estimate.
+// Battery readings are smoothed by an exponential moving average and mapped
+// through the discharge curve of the pack. The discharge slope comes from the
+// average current of the energy model, so the days left until the low battery
+// cutoff are known long before the voltage starts to drop. The smoothed
+// values are kept in the backup registers across a reset.
+
+#ifndef SOC_H
+#define SOC_H
+
+#include "main.h"
+#include <stdbool.h>
+
+#ifndef SOC_CAPACITY_MAH
+#define SOC_CAPACITY_MAH	2500			// Usable capacity of the 4 x AA alkaline pack
+#endif
+#ifndef SOC_CUTOFF_MV
+#define SOC_CUTOFF_MV		4750			// Low battery cutoff, the valve must still close below it
+#endif
+#define SOC_EMA_SHIFT		3				// Voltage average weight 1/8, one reading per battery report
+#define SOC_LOAD_SHIFT		2				// Current average weight 1/4
+
+// State of charge estimate
+typedef struct
+{
+	uint16_t mv;							// Smoothed battery voltage
+	uint16_t permille;						// State of charge from the discharge curve
+	uint16_t load_ua;						// Smoothed average supply current
+	uint32_t slope_ppm;						// Discharge slope, millionths of the capacity per day
+	uint32_t days;							// Days until the cutoff at the current slope
+} soc_status_t;
+
+void soc_init(void);						// Restore the retained averages, call after backup_init
+void soc_update(uint16_t mv);				// Add a battery reading in mV
+const soc_status_t *soc_status(void);		// Latest estimate
+uint16_t soc_permille(uint16_t mv);			// Map a battery voltage through the discharge curve
+
+#endif /* SOC_H */
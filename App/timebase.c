@@ -0,0 +1,129 @@
+// Program Description: SysTick and RTC combined monotonic time base.
+
+#include "timebase.h"
+#include "scheduler.h"
+#include "trace.h"
+
+extern RTC_HandleTypeDef hrtc;				// Declare RTC handler
+
+static uint32_t stop_rtc_ms;				// RTC time when STOP was entered
+static uint32_t last_stop_ms;				// Duration of the last STOP period
+static uint32_t stop_systick;				// SysTick value just before WFI, the counter resumes on wake
+static uint32_t wake_us;					// Time from wake up to the end of tb_stop_wake
+static uint32_t wake_ref_us;				// sched_now_us() once the tick was restored
+static volatile bool wake_pending;			// Waiting for the first wake handler after STOP
+static sched_sleep_t wake_profile;			// STOP profile of the last STOP period
+static tb_wake_stats_t wake_stats[SCHED_SLEEP_COUNT][TB_WAKE_COUNT];
+
+// Days before the first of each month in a non leap year
+static const uint16_t month_days[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+// Function to read the RTC calendar as seconds since 2000-01-01 and the milliseconds within the second
+static uint32_t tb_rtc_read(uint32_t *ms)
+{
+	RTC_TimeTypeDef sTime;
+	RTC_DateTypeDef sDate;
+	RTC_TimeTypeDef check;
+	// The shadow registers are bypassed, read again until the time did not move during the read
+	do
+	{
+		HAL_RTC_GetTime(&hrtc, &sTime, RTC_FORMAT_BIN);
+		HAL_RTC_GetDate(&hrtc, &sDate, RTC_FORMAT_BIN);
+		HAL_RTC_GetTime(&hrtc, &check, RTC_FORMAT_BIN);
+	} while (check.SubSeconds != sTime.SubSeconds || check.Seconds != sTime.Seconds);
+
+	uint32_t days = sDate.Year * 365 + (sDate.Year + 3) / 4 + month_days[sDate.Month - 1] + sDate.Date - 1;
+	if ((sDate.Year % 4) == 0 && sDate.Month > 2)
+	{
+		days++;								// Leap day of the current year
+	}
+	*ms = ((sTime.SecondFraction - sTime.SubSeconds) * 1000) / (sTime.SecondFraction + 1);
+	return ((days * 24 + sTime.Hours) * 60 + sTime.Minutes) * 60 + sTime.Seconds;
+}
+
+// Function to read the RTC calendar as milliseconds since 2000-01-01
+uint32_t tb_rtc_ms(void)
+{
+	uint32_t ms;
+	uint32_t s = tb_rtc_read(&ms);
+
+	// Unsigned arithmetic wraps consistently, so differences stay valid
+	return s * 1000 + ms;
+}
+
+// Function to read the RTC calendar as seconds since 2000-01-01
+uint32_t tb_rtc_seconds(void)
+{
+	uint32_t ms;
+	return tb_rtc_read(&ms);
+}
+
+// Function to read the calendar registers directly, so leaving STOP does not wait for a shadow synchronisation
+void tb_init(void)
+{
+	HAL_RTCEx_EnableBypassShadow(&hrtc);
+}
+
+// Function to record the RTC time and suspend SysTick before entering STOP mode
+void tb_stop_enter(void)
+{
+	stop_rtc_ms = tb_rtc_ms();
+	wake_profile = sched_get_sleep();
+	HAL_SuspendTick();
+	stop_systick = SysTick->VAL;			// SysTick keeps counting without its interrupt until WFI
+}
+
+// Function to take the wake up time reference, the first call after WFI
+void tb_stop_wake(void)
+{
+	// The counter stopped with the core clock, so it now holds the cycles spent since wake up
+	uint32_t load = SysTick->LOAD + 1;
+	uint32_t cycles = stop_systick - SysTick->VAL;
+	if ((int32_t)cycles < 0)
+	{
+		cycles += load;						// Wrapped through the reload value
+	}
+	wake_us = (cycles * 1000) / load;
+}
+
+// Function to account the time spent in STOP mode and resume SysTick
+void tb_stop_exit(void)
+{
+	last_stop_ms = tb_rtc_ms() - stop_rtc_ms;
+	uwTick += last_stop_ms;
+	HAL_ResumeTick();
+	wake_ref_us = sched_now_us();
+	wake_pending = true;
+}
+
+// Function to record the wake to handler latency, called first in every handler that can wake the core
+void tb_wake_handler(tb_wake_t source)
+{
+	if (!wake_pending)
+	{
+		return;
+	}
+	wake_pending = false;
+	uint32_t latency = wake_us + (sched_now_us() - wake_ref_us);
+	tb_wake_stats_t *st = &wake_stats[wake_profile][source];
+	st->count++;
+	st->total_us += latency;
+	st->last_us = latency;
+	if (latency > st->max_us)
+	{
+		st->max_us = latency;
+	}
+	trace_record(TRACE_WAKE_HANDLER, source);
+}
+
+// Function to get the wake latency statistics of one source after STOP with one profile
+const tb_wake_stats_t *tb_wake_stats(tb_wake_t source, sched_sleep_t profile)
+{
+	return &wake_stats[profile][source];
+}
+
+// Function to get the duration of the last STOP period
+uint32_t tb_last_stop_ms(void)
+{
+	return last_stop_ms;
+}
@@ -0,0 +1,43 @@
+// Monotonic time base that keeps running across STOP mode.
+// SysTick provides the millisecond tick while awake. The RTC calendar and
+// subseconds measure the time spent in STOP, and HAL_GetTick() is advanced by
+// that amount on wake, so every tick based deadline stays on wall-clock time.
+// Wake latency is kept per source and per STOP profile, so the profiles can be
+// compared on the same unit.
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include "main.h"
+#include "scheduler.h"
+#include <stdbool.h>
+
+// Handlers that can run first after STOP
+typedef enum
+{
+	TB_WAKE_FLOOD = 0,						// PB6 flood sensor edge
+	TB_WAKE_BUTTON,							// PA15 button edge
+	TB_WAKE_RTC,							// RTC alarm A
+	TB_WAKE_COUNT
+} tb_wake_t;
+
+// Wake to handler latency of one source
+typedef struct
+{
+	uint32_t count;							// Wakes handled first by this source
+	uint32_t total_us;						// Sum of the latencies, for the average
+	uint32_t last_us;						// Latency of the last one
+	uint32_t max_us;						// Worst latency
+} tb_wake_stats_t;
+
+void tb_init(void);							// Bypass the RTC shadow registers
+void tb_stop_enter(void);					// Record the RTC time and suspend SysTick before STOP
+void tb_stop_wake(void);					// Take the latency reference, first call after WFI
+void tb_stop_exit(void);					// Add the time spent in STOP to the tick and resume SysTick
+void tb_wake_handler(tb_wake_t source);		// Record the latency if this is the first handler after STOP
+const tb_wake_stats_t *tb_wake_stats(tb_wake_t source, sched_sleep_t profile);	// Wake latency of one source from one STOP profile
+uint32_t tb_rtc_ms(void);					// RTC calendar time in ms, wraps after about 49 days
+uint32_t tb_rtc_seconds(void);				// RTC calendar time in seconds since 2000-01-01
+uint32_t tb_last_stop_ms(void);				// Duration of the last STOP period
+
+#endif /* TIMEBASE_H */
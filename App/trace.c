@@ -0,0 +1,63 @@
+// Program Description: RAM trace ring for the flood detection and valve actuation pipeline.
+
+#include "trace.h"
+#include "scheduler.h"
+
+static trace_entry_t entries[TRACE_SIZE];	// Trace ring
+static uint16_t next;						// Free running write index
+static volatile bool paused;				// Recording paused for a dump
+
+static const char *const names[TRACE_ID_COUNT] =
+{
+	[TRACE_FLOOD_EDGE] = "edge",
+	[TRACE_DEBOUNCE_START] = "tim16",
+	[TRACE_FLOOD_CONFIRM] = "confirm",
+	[TRACE_VALVE_START] = "vstart",
+	[TRACE_VALVE_END] = "vend",
+	[TRACE_UART_LOG] = "log",
+	[TRACE_STOP_ENTER] = "stop",
+	[TRACE_STOP_EXIT] = "wake",
+	[TRACE_WAKE_HANDLER] = "handler",
+};
+
+// Function to record a timestamped event
+void trace_record(trace_id_t id, uint16_t arg)
+{
+	if (paused)
+	{
+		return;
+	}
+	uint32_t now = sched_now_us();
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	trace_entry_t *e = &entries[next & (TRACE_SIZE - 1)];
+	e->time_us = now;
+	e->id = id;
+	e->arg = arg;
+	next++;
+	__set_PRIMASK(primask);
+}
+
+// Function to pause or resume recording
+void trace_pause(bool pause)
+{
+	paused = pause;
+}
+
+// Function to get the number of valid entries
+uint8_t trace_count(void)
+{
+	return (next < TRACE_SIZE) ? next : TRACE_SIZE;
+}
+
+// Function to get an entry by age, 0 is the oldest
+const trace_entry_t *trace_get(uint8_t index)
+{
+	return &entries[(next - trace_count() + index) & (TRACE_SIZE - 1)];
+}
+
+// Function to get the short name of a stage
+const char *trace_name(uint8_t id)
+{
+	return (id < TRACE_ID_COUNT) ? names[id] : "?";
+}
@@ -0,0 +1,43 @@
+// Timestamped event trace for the flood detection pipeline.
+// Events are recorded into a small RAM ring and dumped over USART2 on demand,
+// so detection and actuation latency can be measured on installed units.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "main.h"
+#include <stdbool.h>
+
+#define TRACE_SIZE	32						// Number of entries kept, must be a power of two
+
+// Traced pipeline stages
+typedef enum
+{
+	TRACE_FLOOD_EDGE = 0,					// Probe EXTI falling edge, arg = probe
+	TRACE_DEBOUNCE_START,					// Probe debounce window opened, arg = probe
+	TRACE_FLOOD_CONFIRM,					// Debounce verdict, arg = probe << 8 | samples taken, bit 15 set if confirmed
+	TRACE_VALVE_START,						// Valve motion requested, arg = valve_cmd_t
+	TRACE_VALVE_END,						// Valve ramp reached its target, arg = valve_cmd_t
+	TRACE_UART_LOG,							// Line queued to the logger, arg = length
+	TRACE_STOP_ENTER,						// Entering STOP mode, arg = sched_sleep_t
+	TRACE_STOP_EXIT,						// Woken up from STOP mode, arg = sched_sleep_t
+	TRACE_WAKE_HANDLER,						// First handler after STOP, arg = tb_wake_t
+	TRACE_ID_COUNT
+} trace_id_t;
+
+// One trace entry
+typedef struct
+{
+	uint32_t time_us;						// sched_now_us() timestamp
+	uint8_t id;								// trace_id_t
+	uint8_t reserved;
+	uint16_t arg;							// Stage specific argument
+} trace_entry_t;
+
+void trace_record(trace_id_t id, uint16_t arg);	// Record an event, safe from ISRs
+void trace_pause(bool pause);				// Stop recording while a dump is in progress
+uint8_t trace_count(void);					// Number of valid entries
+const trace_entry_t *trace_get(uint8_t index);	// Entry by age, 0 is the oldest
+const char *trace_name(uint8_t id);			// Short name of a stage
+
+#endif /* TRACE_H */
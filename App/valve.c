@@ -0,0 +1,220 @@
+// Program Description: Valve servo motion state machine, the ramp is streamed into TIM3 CCR1 by DMA.
+
+#include "valve.h"
+#include "trace.h"
+#include "power.h"
+#include "clock.h"
+
+extern TIM_HandleTypeDef htim3;      		// Declare Timer 3 handler
+extern DMA_HandleTypeDef hdma_tim3_up;		// Declare TIM3 update DMA handler
+
+// Hold one compare value for a number of TIM3 update events
+#define HOLD4(v)	v, v, v, v
+#define HOLD9(v)	HOLD4(v), HOLD4(v), v
+#define HOLD13(v)	HOLD9(v), HOLD4(v)
+#define HOLD20(v)	HOLD9(v), HOLD9(v), v, v
+
+// 900 to 1800 compare ramp in 50 count steps, each step held by H
+#define RAMP_CLOSE(H)	H(900), H(950), H(1000), H(1050), H(1100), H(1150), H(1200), H(1250), H(1300), H(1350), \
+						H(1400), H(1450), H(1500), H(1550), H(1600), H(1650), H(1700), H(1750), H(1800)
+#define RAMP_OPEN(H)	H(1800), H(1750), H(1700), H(1650), H(1600), H(1550), H(1500), H(1450), H(1400), H(1350), \
+						H(1300), H(1250), H(1200), H(1150), H(1100), H(1050), H(1000), H(950), H(900)
+
+static const uint16_t ramp_close_normal[] = { RAMP_CLOSE(HOLD13) };
+static const uint16_t ramp_open_normal[] = { RAMP_OPEN(HOLD13) };
+static const uint16_t ramp_close_emergency[] = { RAMP_CLOSE(HOLD4) };
+static const uint16_t ramp_open_gentle[] = { RAMP_OPEN(HOLD20) };
+
+// Ramp table for each direction of a profile
+typedef struct
+{
+	const uint16_t *table[2];				// Indexed by valve_cmd_t
+	uint16_t length[2];
+} valve_profile_def_t;
+
+// Profiles without a table for one direction fall back to the normal ramp
+static const valve_profile_def_t profiles[VALVE_PROFILE_COUNT] =
+{
+	[VALVE_PROFILE_NORMAL] =
+	{
+		{ ramp_open_normal, ramp_close_normal },
+		{ sizeof(ramp_open_normal) / sizeof(uint16_t), sizeof(ramp_close_normal) / sizeof(uint16_t) }
+	},
+	[VALVE_PROFILE_EMERGENCY] =
+	{
+		{ ramp_open_normal, ramp_close_emergency },
+		{ sizeof(ramp_open_normal) / sizeof(uint16_t), sizeof(ramp_close_emergency) / sizeof(uint16_t) }
+	},
+	[VALVE_PROFILE_GENTLE] =
+	{
+		{ ramp_open_gentle, ramp_close_normal },
+		{ sizeof(ramp_open_gentle) / sizeof(uint16_t), sizeof(ramp_close_normal) / sizeof(uint16_t) }
+	},
+};
+
+// Motion phases
+typedef enum
+{
+	PHASE_IDLE = 0,
+	PHASE_POWER_UP,							// Valve powered, PWM at the start position
+	PHASE_RAMP,								// DMA streams the ramp table into CCR1
+	PHASE_SETTLE,							// Hold the target position
+	PHASE_POWER_DOWN						// PWM output off, valve still powered
+} valve_phase_t;
+
+static volatile valve_phase_t phase = PHASE_IDLE;	// Current motion phase
+static volatile uint16_t phase_ticks;		// Update events left in the current phase
+static uint16_t settle_ticks;				// Update events per settle phase
+static valve_cmd_t command;					// Motion in progress
+static valve_profile_t ramp_profile;		// Ramp profile of the motion in progress
+static valve_done_t done_cb;				// Completion callback of the motion in progress
+static volatile bool open_state;			// Position commanded by the last request
+static volatile uint32_t reached_time;		// HAL tick when the last ramp reached its target
+
+static void valve_dma_complete(DMA_HandleTypeDef *hdma);
+
+// Function to convert milliseconds into a number of TIM3 update events, call with CLOCK_HOLD_SERVO taken
+static uint16_t valve_ms_to_ticks(uint32_t ms)
+{
+	uint32_t clk = clock_timer_hz();		// The prescaler was re-timed for this clock, not for PCLK
+	uint32_t counts = (htim3.Instance->PSC + 1) * (htim3.Instance->ARR + 1);
+	uint32_t ticks = (uint32_t)(((uint64_t)ms * clk + 500 * counts) / (1000 * (uint64_t)counts));
+	return ticks ? ticks : 1;
+}
+
+// Function to start streaming the ramp from the entry matching the current compare value
+static void valve_start_ramp(void)
+{
+	const uint16_t *table = profiles[ramp_profile].table[command];
+	uint16_t length = profiles[ramp_profile].length[command];
+	uint16_t pulse = __HAL_TIM_GET_COMPARE(&htim3, TIM_CHANNEL_1);
+	uint16_t i = 0;
+
+	// Skip the entries already passed, tables are monotonic
+	while (i < length - 1 && ((command == VALVE_CLOSE) ? table[i] < pulse : table[i] > pulse))
+	{
+		i++;
+	}
+
+	__HAL_TIM_DISABLE_IT(&htim3, TIM_IT_UPDATE);			// No CPU work during the ramp
+	hdma_tim3_up.XferCpltCallback = valve_dma_complete;
+	HAL_DMA_Start_IT(&hdma_tim3_up, (uint32_t)&table[i], (uint32_t)&htim3.Instance->CCR1, length - i);
+	__HAL_TIM_ENABLE_DMA(&htim3, TIM_DMA_UPDATE);
+	phase = PHASE_RAMP;
+}
+
+// Function to start moving the valve towards the requested position
+void valve_request(valve_cmd_t cmd, valve_profile_t profile, valve_done_t done)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	clock_hold(CLOCK_HOLD_SERVO, true);		// TIM3 needs an exact 12 MHz multiple for the pulse widths and the settle ticks
+	command = cmd;
+	ramp_profile = profile;
+	done_cb = done;
+	open_state = (cmd == VALVE_OPEN);
+	settle_ticks = valve_ms_to_ticks(VALVE_SETTLE_MS);
+	trace_record(TRACE_VALVE_START, cmd);
+
+	if (phase == PHASE_IDLE)
+	{
+		// Start a new motion from the opposite end position
+		__HAL_TIM_SET_COMPARE(&htim3, TIM_CHANNEL_1, profiles[profile].table[cmd][0]);
+		HAL_GPIO_WritePin(SERVO_POWER_GPIO_Port, SERVO_POWER_Pin, GPIO_PIN_SET);    	// Activate valve
+		power_begin(POWER_SERVO);
+		HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_1);             	// Start PWM signal for valve control
+		__HAL_TIM_CLEAR_FLAG(&htim3, TIM_FLAG_UPDATE);
+		__HAL_TIM_ENABLE_IT(&htim3, TIM_IT_UPDATE);
+		phase = PHASE_POWER_UP;
+		phase_ticks = settle_ticks;
+	}
+	else
+	{
+		// Reverse or extend the motion in progress from the current position
+		if (phase == PHASE_RAMP)
+		{
+			__HAL_TIM_DISABLE_DMA(&htim3, TIM_DMA_UPDATE);
+			HAL_DMA_Abort(&hdma_tim3_up);
+		}
+		TIM_CCxChannelCmd(htim3.Instance, TIM_CHANNEL_1, TIM_CCx_ENABLE);	// PWM may be off during power down
+		valve_start_ramp();
+	}
+	__set_PRIMASK(primask);
+}
+
+// Function to check whether a motion is in progress
+bool valve_busy(void)
+{
+	return phase != PHASE_IDLE;
+}
+
+// Function to seed the position known from before a reset
+void valve_restore(bool open)
+{
+	if (phase == PHASE_IDLE)
+	{
+		open_state = open;
+	}
+}
+
+// Function to get the position commanded by the last request, open or opening
+bool valve_is_open(void)
+{
+	return open_state;
+}
+
+// Function to get the HAL tick at which the last ramp reached its target
+uint32_t valve_reached_time(void)
+{
+	return reached_time;
+}
+
+// Callback function for the end of the ramp table transfer
+static void valve_dma_complete(DMA_HandleTypeDef *hdma)
+{
+	__HAL_TIM_DISABLE_DMA(&htim3, TIM_DMA_UPDATE);
+	reached_time = HAL_GetTick();
+	trace_record(TRACE_VALVE_END, command);
+	phase = PHASE_SETTLE;
+	phase_ticks = settle_ticks;
+	__HAL_TIM_CLEAR_FLAG(&htim3, TIM_FLAG_UPDATE);
+	__HAL_TIM_ENABLE_IT(&htim3, TIM_IT_UPDATE);
+}
+
+// Function to advance the motion state machine, called on TIM3 update events outside the ramp
+void valve_tim_update(void)
+{
+	if (phase == PHASE_IDLE || phase == PHASE_RAMP || --phase_ticks != 0)
+	{
+		return;
+	}
+
+	switch (phase)
+	{
+	case PHASE_POWER_UP:
+		valve_start_ramp();
+		break;
+
+	case PHASE_SETTLE:
+		TIM_CCxChannelCmd(htim3.Instance, TIM_CHANNEL_1, TIM_CCx_DISABLE);	// Stop PWM signal, keep counting
+		phase = PHASE_POWER_DOWN;
+		phase_ticks = settle_ticks;
+		break;
+
+	case PHASE_POWER_DOWN:
+		__HAL_TIM_DISABLE_IT(&htim3, TIM_IT_UPDATE);
+		HAL_TIM_PWM_Stop(&htim3, TIM_CHANNEL_1);              	// Stop PWM signal
+		HAL_GPIO_WritePin(SERVO_POWER_GPIO_Port, SERVO_POWER_Pin, GPIO_PIN_RESET);  	// Deactivate valve
+		power_end(POWER_SERVO);
+		clock_hold(CLOCK_HOLD_SERVO, false);
+		phase = PHASE_IDLE;
+		if (done_cb)
+		{
+			done_cb(command);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
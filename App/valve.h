@@ -0,0 +1,42 @@
+// Interrupt driven valve servo motion engine.
+// The compare ramp is precomputed into const tables that DMA streams into
+// TIM3 CCR1 on every update event, so the CPU does no work per ramp step and
+// is free to service other events or sleep while the servo moves.
+
+#ifndef VALVE_H
+#define VALVE_H
+
+#include "main.h"
+#include <stdbool.h>
+
+#define VALVE_PULSE_OPEN	900				// TIM3 compare value for the open position
+#define VALVE_PULSE_CLOSED	1800			// TIM3 compare value for the closed position
+#define VALVE_SETTLE_MS		50				// Settle time before the ramp and after it
+
+// Valve motion commands
+typedef enum
+{
+	VALVE_OPEN = 0,
+	VALVE_CLOSE
+} valve_cmd_t;
+
+// Ramp profiles, one entry per TIM3 update event (about 2.3 ms)
+typedef enum
+{
+	VALVE_PROFILE_NORMAL = 0,				// 19 steps of about 30 ms, same as the original ramp
+	VALVE_PROFILE_EMERGENCY,				// 19 steps of about 9 ms, used to close on a flood
+	VALVE_PROFILE_GENTLE,					// 19 steps of about 45 ms, used to reopen after a flood
+	VALVE_PROFILE_COUNT
+} valve_profile_t;
+
+// Completion callback, called from interrupt context
+typedef void (*valve_done_t)(valve_cmd_t cmd);
+
+void valve_request(valve_cmd_t cmd, valve_profile_t profile, valve_done_t done);	// Start a motion, safe from ISRs, replaces any motion in progress
+bool valve_busy(void);						// Check whether the servo is moving
+bool valve_is_open(void);					// Position commanded by the last request
+void valve_restore(bool open);				// Seed the position retained across a reset, ignored while moving
+uint32_t valve_reached_time(void);			// HAL tick when the last ramp reached its target
+void valve_tim_update(void);				// TIM3 update event handler
+
+#endif /* VALVE_H */
@@ -0,0 +1,92 @@
+// Program Description: RTC Alarm A wake schedule for periodic jobs.
+
+#include "wake.h"
+#include "timebase.h"
+
+extern RTC_HandleTypeDef hrtc;				// Declare RTC handler
+
+static uint32_t interval[WAKE_COUNT] = { WAKE_STATUS_S, WAKE_BATTERY_S, WAKE_EXERCISE_S };
+static uint32_t deadline[WAKE_COUNT];		// RTC seconds at which each job is due
+static volatile uint8_t forced;				// Jobs made due by wake_force
+
+// Function to schedule every job one interval from now
+void wake_init(void)
+{
+	uint32_t now = tb_rtc_seconds();
+	for (uint8_t i = 0; i < WAKE_COUNT; i++)
+	{
+		deadline[i] = now + interval[i];
+	}
+	forced = 0;
+}
+
+// Function to change the interval of a job
+void wake_set_interval(wake_job_t job, uint32_t seconds)
+{
+	interval[job] = seconds;
+	deadline[job] = tb_rtc_seconds() + seconds;
+}
+
+// Function to make a job due at the next check
+void wake_force(wake_job_t job)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	forced |= WAKE_BIT(job);
+	__set_PRIMASK(primask);
+}
+
+// Function to collect the due jobs and move their deadlines one interval on
+uint8_t wake_due(void)
+{
+	uint32_t now = tb_rtc_seconds();
+	__disable_irq();
+	uint8_t due = forced;
+	forced = 0;
+	__enable_irq();
+	for (uint8_t i = 0; i < WAKE_COUNT; i++)
+	{
+		if ((int32_t)(now - deadline[i]) >= 0)
+		{
+			due |= WAKE_BIT(i);
+		}
+		if (due & WAKE_BIT(i))
+		{
+			deadline[i] = now + interval[i];	// A late or forced run restarts the interval
+		}
+	}
+	return due;
+}
+
+// Function to program Alarm A for the earliest deadline
+void wake_program(void)
+{
+	uint32_t now = tb_rtc_seconds();
+	uint32_t next = deadline[0];
+	for (uint8_t i = 1; i < WAKE_COUNT; i++)
+	{
+		if ((int32_t)(deadline[i] - next) < 0)
+		{
+			next = deadline[i];
+		}
+	}
+	if ((int32_t)(next - now) < WAKE_MIN_LEAD)
+	{
+		next = now + WAKE_MIN_LEAD;
+	}
+
+	// The alarm matches the time of day only, a deadline more than a day ahead costs one extra wake per day
+	uint32_t sod = next % 86400;
+	RTC_AlarmTypeDef sAlarm = {0};
+	sAlarm.AlarmTime.Hours = sod / 3600;
+	sAlarm.AlarmTime.Minutes = (sod / 60) % 60;
+	sAlarm.AlarmTime.Seconds = sod % 60;
+	sAlarm.AlarmTime.DayLightSaving = RTC_DAYLIGHTSAVING_NONE;
+	sAlarm.AlarmTime.StoreOperation = RTC_STOREOPERATION_RESET;
+	sAlarm.AlarmMask = RTC_ALARMMASK_DATEWEEKDAY;
+	sAlarm.AlarmSubSecondMask = RTC_ALARMSUBSECONDMASK_ALL;
+	sAlarm.AlarmDateWeekDaySel = RTC_ALARMDATEWEEKDAYSEL_DATE;
+	sAlarm.AlarmDateWeekDay = 1;
+	sAlarm.Alarm = RTC_ALARM_A;
+	HAL_RTC_SetAlarm_IT(&hrtc, &sAlarm, RTC_FORMAT_BIN);
+}
@@ -0,0 +1,40 @@
+// RTC wake schedule for the periodic jobs of an idle unit.
+// Every job has an interval and a deadline on the RTC calendar. Alarm A is
+// programmed for the earliest deadline, so STOP is only left for real work.
+
+#ifndef WAKE_H
+#define WAKE_H
+
+#include "main.h"
+
+// Default job intervals in seconds, override from the build flags, power.c accounts STOP periods of any length
+#ifndef WAKE_STATUS_S
+#define WAKE_STATUS_S		60				// Status LED blink
+#endif
+#ifndef WAKE_BATTERY_S
+#define WAKE_BATTERY_S		3600			// Battery check and awake time report
+#endif
+#ifndef WAKE_EXERCISE_S
+#define WAKE_EXERCISE_S		604800			// Close and reopen the valve so it does not seize
+#endif
+
+#define WAKE_MIN_LEAD		2				// Closest alarm from now (s), a passed time of day would fire tomorrow
+
+// Periodic jobs
+typedef enum
+{
+	WAKE_STATUS = 0,
+	WAKE_BATTERY,
+	WAKE_EXERCISE,
+	WAKE_COUNT
+} wake_job_t;
+
+#define WAKE_BIT(job)		(1u << (job))	// Bit of a job in the wake_due mask
+
+void wake_init(void);						// Schedule every job one interval from now
+void wake_set_interval(wake_job_t job, uint32_t seconds);	// Change an interval, the next deadline is one interval from now
+void wake_force(wake_job_t job);			// Make a job due at the next check, safe from ISRs
+uint8_t wake_due(void);						// Mask of due jobs, each one is rescheduled
+void wake_program(void);					// Program Alarm A for the earliest deadline
+
+#endif /* WAKE_H */
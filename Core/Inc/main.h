@@ -55,12 +55,29 @@ void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim);
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+int app_main(void);
 
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
 
 /* USER CODE BEGIN Private defines */
+#define FLOOD_SENSOR_Pin GPIO_PIN_6
+#define FLOOD_SENSOR_GPIO_Port GPIOB
+#define FLOOD_SENSOR2_Pin GPIO_PIN_13
+#define FLOOD_SENSOR2_GPIO_Port GPIOC
+#define BUTTON_Pin GPIO_PIN_15
+#define BUTTON_GPIO_Port GPIOA
+#define SERVO_POWER_Pin GPIO_PIN_9
+#define SERVO_POWER_GPIO_Port GPIOA
+#define BATT_SENSE_EN_Pin GPIO_PIN_15
+#define BATT_SENSE_EN_GPIO_Port GPIOB
+#define STATUS_LED_Pin GPIO_PIN_7
+#define STATUS_LED_GPIO_Port GPIOB
+#define BUZZER_Pin GPIO_PIN_8
+#define BUZZER_GPIO_Port GPIOB
+#define WARNING_LED_Pin GPIO_PIN_9
+#define WARNING_LED_GPIO_Port GPIOB
 
 /* USER CODE END Private defines */
 
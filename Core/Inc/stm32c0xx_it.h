@@ -56,6 +56,13 @@ void EXTI4_15_IRQHandler(void);
 void TIM3_IRQHandler(void);
 void TIM16_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void DMA1_Channel1_IRQHandler(void);
+void DMA1_Channel2_3_IRQHandler(void);
+void USART2_IRQHandler(void);
+void TIM14_IRQHandler(void);
+void ADC1_IRQHandler(void);
+void EXTI0_1_IRQHandler(void);
+void EXTI2_3_IRQHandler(void);
 
 /* USER CODE END EFP */
 
@@ -50,6 +50,10 @@ TIM_HandleTypeDef htim16;
 UART_HandleTypeDef huart2;
 
 /* USER CODE BEGIN PV */
+DMA_HandleTypeDef hdma_tim3_up;
+TIM_HandleTypeDef htim14;
+DMA_HandleTypeDef hdma_usart2_tx;
+DMA_HandleTypeDef hdma_adc1;
 
 /* USER CODE END PV */
 
@@ -62,6 +66,7 @@ static void MX_USART2_UART_Init(void);
 static void MX_RTC_Init(void);
 static void MX_TIM16_Init(void);
 /* USER CODE BEGIN PFP */
+static void MX_TIM14_Init(void);
 
 /* USER CODE END PFP */
 
@@ -104,6 +109,7 @@ int main(void)
   MX_RTC_Init();
   MX_TIM16_Init();
   /* USER CODE BEGIN 2 */
+  MX_TIM14_Init();
   app_main();
   /* USER CODE END 2 */
 
@@ -407,7 +413,12 @@ static void MX_TIM3_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN TIM3_Init 2 */
-
+  // The update event paces the ADC burst of the battery sag capture during a valve motion
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_UPDATE;
+  if (HAL_TIMEx_MasterConfigSynchronization(&htim3, &sMasterConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
   /* USER CODE END TIM3_Init 2 */
   HAL_TIM_MspPostInit(&htim3);
 
@@ -579,6 +590,31 @@ static void MX_GPIO_Init(void)
 
 /* USER CODE BEGIN 4 */
 
+/**
+  * @brief TIM14 Initialization Function, 1 ms time base for the LED and buzzer patterns
+  * @param None
+  * @retval None
+  */
+static void MX_TIM14_Init(void)
+{
+  __HAL_RCC_TIM14_CLK_ENABLE();
+
+  htim14.Instance = TIM14;
+  htim14.Init.Prescaler = HAL_RCC_GetPCLK1Freq() / 1000 - 1;
+  htim14.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim14.Init.Period = 0xFFFF;
+  htim14.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim14.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim14) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* TIM14 interrupt Init */
+  HAL_NVIC_SetPriority(TIM14_IRQn, 3, 0);
+  HAL_NVIC_EnableIRQ(TIM14_IRQn);
+}
+
 /* USER CODE END 4 */
 
 /**
@@ -46,7 +46,7 @@
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN PFP */
-
+void probe_irq(void);						/* Flood probe edges, App/probe.c */
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -59,6 +59,12 @@ extern RTC_HandleTypeDef hrtc;
 extern TIM_HandleTypeDef htim3;
 extern TIM_HandleTypeDef htim16;
 /* USER CODE BEGIN EV */
+extern DMA_HandleTypeDef hdma_tim3_up;
+extern TIM_HandleTypeDef htim14;
+extern DMA_HandleTypeDef hdma_usart2_tx;
+extern UART_HandleTypeDef huart2;
+extern ADC_HandleTypeDef hadc1;
+extern DMA_HandleTypeDef hdma_adc1;
 
 /* USER CODE END EV */
 
@@ -162,6 +168,7 @@ void RTC_IRQHandler(void)
 void EXTI4_15_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI4_15_IRQn 0 */
+  probe_irq();
 
   /* USER CODE END EXTI4_15_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_6);
@@ -201,4 +208,61 @@ void TIM16_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+  * @brief This function handles DMA1 channel 1 interrupt (TIM3 update, valve ramp).
+  */
+void DMA1_Channel1_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_tim3_up);
+}
+
+/**
+  * @brief This function handles DMA1 channel 2 and channel 3 interrupts (USART2 TX, ADC1 scan).
+  */
+void DMA1_Channel2_3_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_usart2_tx);
+  HAL_DMA_IRQHandler(&hdma_adc1);
+}
+
+/**
+  * @brief This function handles USART2 global interrupt.
+  */
+void USART2_IRQHandler(void)
+{
+  HAL_UART_IRQHandler(&huart2);
+}
+
+/**
+  * @brief This function handles TIM14 global interrupt (LED and buzzer patterns).
+  */
+void TIM14_IRQHandler(void)
+{
+  HAL_TIM_IRQHandler(&htim14);
+}
+
+/**
+  * @brief This function handles EXTI line 0 and 1 interrupts (flood probes).
+  */
+void EXTI0_1_IRQHandler(void)
+{
+  probe_irq();
+}
+
+/**
+  * @brief This function handles EXTI line 2 and 3 interrupts (flood probes).
+  */
+void EXTI2_3_IRQHandler(void)
+{
+  probe_irq();
+}
+
+/**
+  * @brief This function handles ADC1 interrupt (battery measurement).
+  */
+void ADC1_IRQHandler(void)
+{
+  HAL_ADC_IRQHandler(&hadc1);
+}
+
 /* USER CODE END 1 */
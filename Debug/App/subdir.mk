@@ -5,13 +5,58 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
-../App/app_main.c 
+../App/app_main.c \
+../App/backup.c \
+../App/battery.c \
+../App/clock.c \
+../App/debounce.c \
+../App/fmt.c \
+../App/logger.c \
+../App/pattern.c \
+../App/power.c \
+../App/probe.c \
+../App/scheduler.c \
+../App/soc.c \
+../App/timebase.c \
+../App/trace.c \
+../App/valve.c \
+../App/wake.c 
 
 OBJS += \
-./App/app_main.o 
+./App/app_main.o \
+./App/backup.o \
+./App/battery.o \
+./App/clock.o \
+./App/debounce.o \
+./App/fmt.o \
+./App/logger.o \
+./App/pattern.o \
+./App/power.o \
+./App/probe.o \
+./App/scheduler.o \
+./App/soc.o \
+./App/timebase.o \
+./App/trace.o \
+./App/valve.o \
+./App/wake.o 
 
 C_DEPS += \
-./App/app_main.d 
+./App/app_main.d \
+./App/backup.d \
+./App/battery.d \
+./App/clock.d \
+./App/debounce.d \
+./App/fmt.d \
+./App/logger.d \
+./App/pattern.d \
+./App/power.d \
+./App/probe.d \
+./App/scheduler.d \
+./App/soc.d \
+./App/timebase.d \
+./App/trace.d \
+./App/valve.d \
+./App/wake.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -21,7 +66,7 @@ App/%.o App/%.su App/%.cyclo: ../App/%.c App/subdir.mk
 clean: clean-App
 
 clean-App:
-	-$(RM) ./App/app_main.cyclo ./App/app_main.d ./App/app_main.o ./App/app_main.su
+	-$(RM) ./App/app_main.cyclo ./App/app_main.d ./App/app_main.o ./App/app_main.su ./App/backup.cyclo ./App/backup.d ./App/backup.o ./App/backup.su ./App/battery.cyclo ./App/battery.d ./App/battery.o ./App/battery.su ./App/clock.cyclo ./App/clock.d ./App/clock.o ./App/clock.su ./App/debounce.cyclo ./App/debounce.d ./App/debounce.o ./App/debounce.su ./App/fmt.cyclo ./App/fmt.d ./App/fmt.o ./App/fmt.su ./App/logger.cyclo ./App/logger.d ./App/logger.o ./App/logger.su ./App/pattern.cyclo ./App/pattern.d ./App/pattern.o ./App/pattern.su ./App/power.cyclo ./App/power.d ./App/power.o ./App/power.su ./App/probe.cyclo ./App/probe.d ./App/probe.o ./App/probe.su ./App/scheduler.cyclo ./App/scheduler.d ./App/scheduler.o ./App/scheduler.su ./App/soc.cyclo ./App/soc.d ./App/soc.o ./App/soc.su ./App/timebase.cyclo ./App/timebase.d ./App/timebase.o ./App/timebase.su ./App/trace.cyclo ./App/trace.d ./App/trace.o ./App/trace.su ./App/valve.cyclo ./App/valve.d ./App/valve.o ./App/valve.su ./App/wake.cyclo ./App/wake.d ./App/wake.o ./App/wake.su
 
 .PHONY: clean-App
 
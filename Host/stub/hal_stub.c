@@ -0,0 +1,1526 @@
+// Program Description: Peripheral models of the simulated board and the HAL functions the firmware calls.
+
+#include "host.h"
+#include "sim.h"
+#include "battery.h"
+#include "valve.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PORT_COUNT			6				// GPIOA to GPIOF, the C031 has no GPIOE
+#define GPIO_MODE_MASK		0x00000003u		// MODER value of a HAL mode
+#define GPIO_MODER_OUTPUT	1u
+#define GPIO_MODER_AF		2u
+#define GPIO_MODER_ANALOG	3u
+#define GPIO_OUTPUT_OD		0x00000010u		// Open drain output type of a HAL mode
+#define GPIO_EXTI_MODE		0x10000000u		// HAL mode with an EXTI line
+#define GPIO_EXTI_IT		0x00010000u		// EXTI line raises an interrupt
+#define GPIO_EXTI_EVT		0x00020000u		// EXTI line raises an event
+#define GPIO_EXTI_RISING	0x00100000u		// EXTI line on the rising edge
+#define GPIO_EXTI_FALLING	0x00200000u		// EXTI line on the falling edge
+#define TIM_COUNT			3				// TIM3, TIM14 and TIM16
+#define DMA_COUNT			3				// DMA1 channels 1 to 3
+#define ADC_RANKS			8				// Regular sequencer ranks
+#define ADC_CONV_CLOCKS		173				// 160.5 sampling and 12.5 conversion ADC clocks
+#define SERVO_PULSE_MIN		450				// Shortest pulse the servo follows, about 0.5 ms
+#define SERVO_PULSE_MAX		2250			// Longest pulse the servo follows, about 2.5 ms
+#define SERVO_SLEW			13				// Compare counts the servo turns per PWM frame, end to end in 0.16 s
+#define SERVO_UA_MOVE		250000			// Servo current while turning
+#define SERVO_UA_HOLD		10000			// Servo current holding its position
+#define CONSOLE_SIZE		65536			// Console capture, the older half is dropped when full
+
+const uint16_t UARTPrescTable[12] = { 1, 2, 4, 6, 8, 10, 12, 16, 32, 64, 128, 256 };
+
+// Inputs and cached registers of one GPIO port
+typedef struct
+{
+	uint32_t moder;							// MODER of the last scan
+	uint32_t pupdr;							// PUPDR of the last scan
+	uint32_t odr;							// ODR of the last scan
+	uint16_t level;							// Pin levels of the last scan, mirrored in IDR
+	uint8_t drive[16];						// host_pin_t of every pin
+} gpio_state_t;
+
+// Counter of one timer
+typedef struct
+{
+	TIM_TypeDef *tim;
+	IRQn_Type irq;
+	uint32_t phase;							// Cycles into the current timer clock period
+	uint32_t psc;							// Active prescaler, PSC is loaded at the update event
+	uint32_t psc_cnt;						// Timer clocks into the current counter period
+	uint32_t cnt;							// Counter as last written back to CNT
+} tim_state_t;
+
+// One DMA channel
+typedef struct
+{
+	DMA_HandleTypeDef *hdma;
+	uint32_t mem;							// Memory address of the transfer
+	uint16_t len;							// Transfers programmed
+	uint16_t left;							// Transfers left, mirrored in CNDTR
+	bool on;								// Channel enabled
+	bool ht;								// Half transfer flag
+	bool tc;								// Transfer complete flag
+	bool ht_ie;								// Half transfer interrupt enabled
+	bool tc_ie;								// Transfer complete interrupt enabled
+} dma_state_t;
+
+static GPIO_TypeDef *const gpio_ports[PORT_COUNT] = { GPIOA, GPIOB, GPIOC, GPIOD, NULL, GPIOF };
+static gpio_state_t gpio[PORT_COUNT];
+
+static tim_state_t tims[TIM_COUNT] =
+{
+	{ TIM3, TIM3_IRQn },
+	{ TIM14, TIM14_IRQn },
+	{ TIM16, TIM16_IRQn },
+};
+
+static dma_state_t dma[DMA_COUNT];
+
+// ADC1 with its regular sequencer
+static struct
+{
+	ADC_HandleTypeDef *hadc;
+	uint32_t ranks[ADC_RANKS];				// Channel of every rank
+	bool awd;								// AWD1 watches the conversions
+	uint32_t awd_low;						// AWD1 low threshold
+	bool started;							// Start_DMA done, converting or waiting for TIM3 TRGO
+	bool converting;						// A sequence is running
+	uint8_t rank;							// Rank being converted
+	uint32_t phase;							// Cycles into the current ADC clock period
+	uint64_t left;							// ADC clocks to the end of the conversion
+} adc;
+
+// USART2, the transmit DMA is folded into the wire time
+static struct
+{
+	UART_HandleTypeDef *huart;
+	const uint8_t *tx;						// Block being sent
+	uint16_t tx_len;
+	uint64_t tx_left;						// Cycles until the last stop bit has left
+	uint32_t tx_bit;						// BRR x PCLK divider when the block started
+	bool tx_glitch;							// The bit time changed during the block
+	bool tx_done;							// Transmit complete, for the interrupt
+	bool rx_done;							// Receive complete, for the interrupt
+	uint32_t glitches;
+} uart;
+
+// RTC calendar and Alarm A
+static struct
+{
+	RTC_HandleTypeDef *hrtc;
+	uint32_t base_s;						// Calendar seconds since 2000-01-01 at base_t
+	uint64_t base_t;						// Start of a calendar second
+	bool alarm_on;
+	bool alarm_flag;
+	RTC_AlarmTypeDef alarm;					// Binary fields
+	uint64_t alarm_at;						// Time of the next match, SIM_NEVER if none
+} rtc;
+
+// Servo on TIM3 CH1, powered from PA9
+static struct
+{
+	uint16_t pos;							// Position as the compare value it settled at
+	uint16_t target;						// Compare value latched at the last update
+	bool moving;							// Turned during the last PWM frame
+} servo;
+
+static uint32_t bkp[PWR_BKP_NUMBER];		// Backup registers, kept by a reset
+static uint16_t batt_mv;					// Open circuit voltage of the pack
+static uint16_t batt_mohm;					// Internal resistance of the pack
+static uint16_t vdda_mv;					// Analog supply
+static char console[CONSOLE_SIZE + 1];		// Bytes sent on USART2
+static uint32_t console_len;
+
+// Days before the first of each month in a non leap year
+static const uint16_t month_days[13] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 };
+
+// Function to get the index of a GPIO port
+static uint8_t gpio_index(const GPIO_TypeDef *port)
+{
+	return (uint8_t)(((uintptr_t)port - IOPORT_BASE) / (GPIOB_BASE - GPIOA_BASE));
+}
+
+// Function to get the level of a pin, a driven input beats the pin, water only beats the pull-up
+static bool gpio_level(uint8_t p, uint8_t pin)
+{
+	GPIO_TypeDef *port = gpio_ports[p];
+	uint32_t mode = (port->MODER >> (pin * 2)) & 3;
+	uint32_t pull = (port->PUPDR >> (pin * 2)) & 3;
+	uint8_t drive = gpio[p].drive[pin];
+	if (mode == 3)
+	{
+		return false;						// Analog, the Schmitt trigger is off
+	}
+	if (drive == HOST_PIN_HIGH || drive == HOST_PIN_LOW)
+	{
+		return drive == HOST_PIN_HIGH;
+	}
+	if (mode == 1 || mode == 2)
+	{
+		return (port->ODR >> pin) & 1;
+	}
+	if (drive == HOST_PIN_WET)
+	{
+		return false;
+	}
+	return pull != GPIO_PULLDOWN;			// Unpulled inputs follow the pull-ups of the board
+}
+
+// Function to read the pins again and flag the EXTI edges, a configuration change raises none
+static void gpio_scan(bool edges)
+{
+	for (uint8_t p = 0; p < PORT_COUNT; p++)
+	{
+		GPIO_TypeDef *port = gpio_ports[p];
+		if (port == NULL)
+		{
+			continue;
+		}
+		uint16_t level = 0;
+		for (uint8_t pin = 0; pin < 16; pin++)
+		{
+			level |= (uint16_t)gpio_level(p, pin) << pin;
+		}
+		uint16_t changed = level ^ gpio[p].level;
+		gpio[p].level = level;
+		gpio[p].moder = port->MODER;
+		gpio[p].pupdr = port->PUPDR;
+		gpio[p].odr = port->ODR;
+		port->IDR = level;
+		for (uint8_t pin = 0; edges && pin < 16; pin++)
+		{
+			uint32_t line = 1u << pin;
+			uint32_t sel = (EXTI->EXTICR[pin >> 2] >> ((pin & 3) * 8)) & 0xFF;
+			if (!(changed & line) || sel != p)
+			{
+				continue;
+			}
+			if ((level & line) && (EXTI->RTSR1 & line))
+			{
+				EXTI->RPR1 |= line;
+			}
+			if (!(level & line) && (EXTI->FTSR1 & line))
+			{
+				EXTI->FPR1 |= line;
+			}
+		}
+	}
+}
+
+// Function to apply BSRR and BRR writes and rescan the pins after a register change
+static void gpio_sync(void)
+{
+	bool changed = false;
+	for (uint8_t p = 0; p < PORT_COUNT; p++)
+	{
+		GPIO_TypeDef *port = gpio_ports[p];
+		if (port == NULL)
+		{
+			continue;
+		}
+		if (port->BSRR || port->BRR)
+		{
+			uint32_t bsrr = port->BSRR;
+			port->ODR = ((port->ODR & ~(bsrr >> 16) & ~port->BRR) | bsrr) & 0xFFFF;
+			port->BSRR = 0;
+			port->BRR = 0;
+		}
+		changed |= port->MODER != gpio[p].moder || port->PUPDR != gpio[p].pupdr || port->ODR != gpio[p].odr;
+	}
+	if (changed)
+	{
+		gpio_scan(true);
+	}
+}
+
+// Function to check whether the firmware drives an output high
+static bool gpio_out(GPIO_TypeDef *port, uint16_t pin)
+{
+	return (port->IDR & pin) != 0 && (port->MODER & (3u << (__builtin_ctz(pin) * 2))) == (1u << (__builtin_ctz(pin) * 2));
+}
+
+// Function to get the servo supply current
+static uint32_t servo_ua(void)
+{
+	if (!gpio_out(SERVO_POWER_GPIO_Port, SERVO_POWER_Pin))
+	{
+		return 0;
+	}
+	return servo.moving ? SERVO_UA_MOVE : SERVO_UA_HOLD;
+}
+
+// Function to turn the servo towards the pulse of one PWM frame
+static void servo_frame(void)
+{
+	bool driven = gpio_out(SERVO_POWER_GPIO_Port, SERVO_POWER_Pin) && (TIM3->CCER & TIM_CCER_CC1E) && (TIM3->CR1 & TIM_CR1_CEN);
+	uint16_t from = servo.pos;
+	if (driven && servo.target >= SERVO_PULSE_MIN && servo.target <= SERVO_PULSE_MAX)
+	{
+		if (servo.target > servo.pos)
+		{
+			servo.pos = (servo.target - servo.pos > SERVO_SLEW) ? servo.pos + SERVO_SLEW : servo.target;
+		}
+		else
+		{
+			servo.pos = (servo.pos - servo.target > SERVO_SLEW) ? servo.pos - SERVO_SLEW : servo.target;
+		}
+	}
+	servo.moving = servo.pos != from;
+}
+
+// Function to get the index of a DMA channel
+static uint8_t dma_index(const DMA_Channel_TypeDef *ch)
+{
+	return (ch == DMA1_Channel1) ? 0 : (ch == DMA1_Channel2) ? 1 : 2;
+}
+
+// Function to serve one DMA request of a peripheral register
+static void dma_request(uint8_t i, __IO uint32_t *reg)
+{
+	dma_state_t *d = &dma[i];
+	if (!d->on || d->left == 0)
+	{
+		return;
+	}
+	DMA_InitTypeDef *init = &d->hdma->Init;
+	uint32_t size = (init->MemDataAlignment == DMA_MDATAALIGN_BYTE) ? 1 : (init->MemDataAlignment == DMA_MDATAALIGN_HALFWORD) ? 2 : 4;
+	uintptr_t addr = d->mem + ((init->MemInc == DMA_MINC_ENABLE) ? (uint32_t)(d->len - d->left) * size : 0);
+	if (init->Direction == DMA_MEMORY_TO_PERIPH)
+	{
+		*reg = (size == 1) ? *(uint8_t *)addr : (size == 2) ? *(uint16_t *)addr : *(uint32_t *)addr;
+	}
+	else if (size == 1)
+	{
+		*(uint8_t *)addr = (uint8_t)*reg;
+	}
+	else if (size == 2)
+	{
+		*(uint16_t *)addr = (uint16_t)*reg;
+	}
+	else
+	{
+		*(uint32_t *)addr = *reg;
+	}
+	d->left--;
+	d->ht |= d->left == d->len / 2;
+	if (d->left == 0)
+	{
+		d->tc = true;
+		if (init->Mode == DMA_CIRCULAR)
+		{
+			d->left = d->len;
+		}
+	}
+	d->hdma->Instance->CNDTR = d->left;
+}
+
+// Function to get the interrupt request of a DMA channel
+static bool dma_irq(uint8_t i)
+{
+	return (dma[i].ht && dma[i].ht_ie) || (dma[i].tc && dma[i].tc_ie);
+}
+
+// Function to get the reading of an ADC channel in 12 bit counts
+static uint32_t adc_counts(uint32_t channel)
+{
+	uint32_t mv = 0;
+	if (channel == ADC_CHANNEL_VREFINT)
+	{
+		return ((uint32_t)*VREFINT_CAL_ADDR * VREFINT_CAL_VREF + vdda_mv / 2) / vdda_mv;
+	}
+	if (channel == ADC_CHANNEL_12 && gpio_out(BATT_SENSE_EN_GPIO_Port, BATT_SENSE_EN_Pin))
+	{
+		uint32_t drop = (uint32_t)(((uint64_t)servo_ua() * batt_mohm) / 1000000);
+		mv = (batt_mv > drop) ? (batt_mv - drop) * 256 / BATT_DIVIDER_Q8 : 0;
+	}
+	uint32_t counts = (mv * 4096 + vdda_mv / 2) / vdda_mv;
+	return (counts > 4095) ? 4095 : counts;
+}
+
+// Function to get the ADC clocks of one conversion, all the oversampled ones from one trigger
+static uint64_t adc_clocks(void)
+{
+	uint64_t ratio = adc.hadc->Init.OversamplingMode ? 2u << ((adc.hadc->Init.Oversampling.Ratio >> ADC_CFGR2_OVSR_Pos) & 7) : 1;
+	return ADC_CONV_CLOCKS * ratio;
+}
+
+// Function to start converting the sequence
+static void adc_sequence(void)
+{
+	adc.converting = true;
+	adc.rank = 0;
+	adc.left = adc_clocks();
+}
+
+// Function to end a conversion, the result goes to DR, through AWD1 and out by DMA
+static void adc_convert(void)
+{
+	ADC_InitTypeDef *init = &adc.hadc->Init;
+	uint32_t channel = adc.ranks[adc.rank];
+	uint32_t counts = adc_counts(channel);
+	uint32_t value = counts;
+	if (init->OversamplingMode)
+	{
+		uint32_t ratio = 2u << ((init->Oversampling.Ratio >> ADC_CFGR2_OVSR_Pos) & 7);
+		value = (counts * ratio) >> ((init->Oversampling.RightBitShift >> ADC_CFGR2_OVSS_Pos) & 0xF);
+	}
+	ADC1->DR = value;
+	if (adc.awd && channel == ADC_CHANNEL_12 && counts < adc.awd_low)
+	{
+		ADC1->ISR |= ADC_ISR_AWD1;
+	}
+	dma_request(dma_index(adc.hadc->DMA_Handle->Instance), &ADC1->DR);
+	if (++adc.rank < init->NbrOfConversion)
+	{
+		adc.left = adc_clocks();
+	}
+	else
+	{
+		adc.converting = false;
+		ADC1->ISR |= ADC_ISR_EOS;
+	}
+}
+
+// Function to start a sequence on the TIM3 trigger output
+static void adc_trigger(void)
+{
+	if (adc.started && !adc.converting && adc.hadc->Init.ExternalTrigConv == ADC_EXTERNALTRIG_T3_TRGO)
+	{
+		adc_sequence();
+	}
+}
+
+// Function to get the timer state of a TIM instance
+static tim_state_t *tim_state(const TIM_TypeDef *tim)
+{
+	for (uint8_t i = 0; i < TIM_COUNT; i++)
+	{
+		if (tims[i].tim == tim)
+		{
+			return &tims[i];
+		}
+	}
+	return NULL;
+}
+
+// Function to raise the update event of a timer
+static void tim_update(tim_state_t *t)
+{
+	TIM_TypeDef *tim = t->tim;
+	t->psc = tim->PSC;
+	tim->SR |= TIM_SR_UIF;
+	if (tim == TIM3)
+	{
+		servo.target = (uint16_t)tim->CCR1;	// The preloaded compare value takes effect, then DMA writes the next one
+		if (tim->DIER & TIM_DIER_UDE)
+		{
+			dma_request(0, &tim->CCR1);
+		}
+		if ((tim->CR2 & TIM_CR2_MMS) == TIM_TRGO_UPDATE)
+		{
+			adc_trigger();
+		}
+		servo_frame();
+	}
+}
+
+// Function to check whether a timer counts, ARR 0 blocks the counter
+static bool tim_running(const tim_state_t *t)
+{
+	return !sim_stopped && (t->tim->CR1 & TIM_CR1_CEN) && (t->tim->ARR & 0xFFFF) != 0;
+}
+
+// Function to get the counts to the next update, a counter above ARR runs through 0xFFFF first
+static uint32_t tim_counts(const tim_state_t *t)
+{
+	uint32_t arr = t->tim->ARR & 0xFFFF;
+	return (t->cnt <= arr) ? arr - t->cnt + 1 : 0x10000 - t->cnt + arr + 1;
+}
+
+// Function to take the counter and UG writes of the firmware
+static void tim_sync(tim_state_t *t)
+{
+	TIM_TypeDef *tim = t->tim;
+	if (tim->CNT != t->cnt)
+	{
+		t->cnt = tim->CNT & 0xFFFF;
+	}
+	if (tim->EGR & TIM_EGR_UG)
+	{
+		// The only UG of the firmware re-times the prescaler under URS and writes the counter back itself,
+		// URS is restored before the model sees the write, so the update flag is never raised here
+		tim->EGR = 0;
+		t->psc = tim->PSC;
+		t->psc_cnt = 0;
+	}
+}
+
+// Function to get the cycles to the next update of a timer
+static uint64_t tim_next(const tim_state_t *t)
+{
+	if (!tim_running(t))
+	{
+		return SIM_NEVER;
+	}
+	uint64_t div = (uint64_t)t->psc + 1;
+	uint64_t edges = ((uint64_t)tim_counts(t) - 1) * div + (div - t->psc_cnt);
+	return sim_after(t->phase, edges, sim_timclk_div());
+}
+
+// Function to count the timer clocks of a span
+static void tim_step(tim_state_t *t, uint64_t cycles)
+{
+	if (!tim_running(t))
+	{
+		return;
+	}
+	uint64_t edges = sim_edges(&t->phase, cycles, sim_timclk_div());
+	uint32_t arr = t->tim->ARR & 0xFFFF;
+	while (edges)
+	{
+		uint64_t div = (uint64_t)t->psc + 1;
+		if (edges < div - t->psc_cnt)
+		{
+			t->psc_cnt += (uint32_t)edges;
+			break;
+		}
+		edges -= div - t->psc_cnt;
+		t->psc_cnt = 0;
+		if (t->cnt == arr)
+		{
+			t->cnt = 0;
+			tim_update(t);
+			continue;
+		}
+		t->cnt = (t->cnt + 1) & 0xFFFF;
+		uint64_t whole = edges / div;
+		uint64_t room = tim_counts(t) - 1;	// Counts before the one that updates
+		if (whole > room)
+		{
+			whole = room;
+		}
+		t->cnt = (uint32_t)((t->cnt + whole) & 0xFFFF);
+		edges -= whole * div;
+	}
+	t->tim->CNT = t->cnt;
+}
+
+// Function to load a timer from its handle as the HAL time base setup does
+static void tim_setup(TIM_HandleTypeDef *htim)
+{
+	TIM_TypeDef *tim = htim->Instance;
+	tim_state_t *t = tim_state(tim);
+	MODIFY_REG(tim->CR1, TIM_CR1_ARPE, htim->Init.AutoReloadPreload);
+	tim->ARR = htim->Init.Period;
+	tim->PSC = htim->Init.Prescaler;
+	tim->CNT = 0;
+	if (t != NULL)
+	{
+		t->psc = tim->PSC;
+		t->psc_cnt = 0;
+		t->cnt = 0;
+	}
+	htim->State = HAL_TIM_STATE_READY;
+	for (uint8_t i = 0; i < sizeof(htim->ChannelState) / sizeof(htim->ChannelState[0]); i++)
+	{
+		htim->ChannelState[i] = HAL_TIM_CHANNEL_STATE_READY;
+	}
+}
+
+// Function to get the cycles until the current UART block has left
+static uint64_t uart_next(void)
+{
+	return (uart.tx != NULL && !sim_stopped) ? uart.tx_left : SIM_NEVER;
+}
+
+// Function to send a block, the capture keeps it for the tests
+static void uart_step(uint64_t cycles)
+{
+	if (uart.tx == NULL || sim_stopped)
+	{
+		return;
+	}
+	if (cycles < uart.tx_left)
+	{
+		uart.tx_left -= cycles;
+		return;
+	}
+	if (console_len + uart.tx_len > CONSOLE_SIZE)
+	{
+		uint32_t keep = console_len / 2;
+		memmove(console, console + console_len - keep, keep);
+		console_len = keep;
+	}
+	memcpy(console + console_len, uart.tx, uart.tx_len);
+	console_len += uart.tx_len;
+	console[console_len] = '\0';
+	if (getenv("HOST_CONSOLE") != NULL)
+	{
+		fwrite(uart.tx, 1, uart.tx_len, stdout);
+	}
+	uart.tx = NULL;
+	uart.tx_done = true;
+	USART2->ISR |= USART_ISR_TC;
+}
+
+// Function to get the bit time of USART2 in cycles x 16
+static uint32_t uart_bit(void)
+{
+	return (USART2->BRR & 0xFFFF) * sim_pclk_div();
+}
+
+// Function to get the cycles to the next RTC alarm
+static uint64_t rtc_next(void)
+{
+	return (rtc.alarm_at == SIM_NEVER) ? SIM_NEVER : rtc.alarm_at - sim_now;
+}
+
+// Function to get the calendar seconds at a time
+static uint32_t rtc_seconds_at(uint64_t t)
+{
+	return rtc.base_s + (uint32_t)((t - rtc.base_t) / SIM_HSI_HZ);
+}
+
+// Function to turn days since 2000-01-01 into the year, month and day
+static void rtc_date(uint32_t days, uint8_t *year, uint8_t *month, uint8_t *date)
+{
+	uint8_t y = 0;
+	while (days >= ((y % 4) ? 365u : 366u))
+	{
+		days -= (y % 4) ? 365u : 366u;
+		y++;
+	}
+	uint8_t m = 1;
+	while (m < 12 && days >= month_days[m] + ((y % 4) == 0 && m >= 2))
+	{
+		m++;
+	}
+	*year = y;
+	*month = m;
+	*date = (uint8_t)(days - month_days[m - 1] - ((y % 4) == 0 && m > 2) + 1);
+}
+
+// Function to check whether a calendar second matches Alarm A
+static bool rtc_match(uint32_t s)
+{
+	RTC_AlarmTypeDef *a = &rtc.alarm;
+	uint32_t sod = s % 86400;
+	if (!(a->AlarmMask & RTC_ALARMMASK_SECONDS) && sod % 60 != a->AlarmTime.Seconds)
+	{
+		return false;
+	}
+	if (!(a->AlarmMask & RTC_ALARMMASK_MINUTES) && (sod / 60) % 60 != a->AlarmTime.Minutes)
+	{
+		return false;
+	}
+	if (!(a->AlarmMask & RTC_ALARMMASK_HOURS) && sod / 3600 != a->AlarmTime.Hours)
+	{
+		return false;
+	}
+	if (!(a->AlarmMask & RTC_ALARMMASK_DATEWEEKDAY))
+	{
+		uint8_t y, m, d;
+		rtc_date(s / 86400, &y, &m, &d);
+		uint8_t day = (a->AlarmDateWeekDaySel == RTC_ALARMDATEWEEKDAYSEL_DATE) ? d : (uint8_t)((s / 86400 + 5) % 7 + 1);
+		return day == a->AlarmDateWeekDay;
+	}
+	return true;
+}
+
+// Function to find the next second matching Alarm A after the current one
+static void rtc_schedule(uint64_t now)
+{
+	rtc.alarm_at = SIM_NEVER;
+	if (!rtc.alarm_on)
+	{
+		return;
+	}
+	uint32_t s = rtc_seconds_at(now) + 1;
+	for (uint32_t i = 0; i < 32 * 86400; i++, s++)
+	{
+		if (rtc_match(s))
+		{
+			rtc.alarm_at = rtc.base_t + (uint64_t)(s - rtc.base_s) * SIM_HSI_HZ;
+			return;
+		}
+	}
+}
+
+// Function to reset the peripherals, a power on also clears the backup domain
+void periph_reset(bool power_on)
+{
+	for (uint8_t p = 0; p < PORT_COUNT; p++)
+	{
+		gpio[p].moder = 0;
+		gpio[p].pupdr = 0;
+		gpio[p].odr = 0;
+		gpio[p].level = 0;
+		if (power_on)
+		{
+			memset(gpio[p].drive, HOST_PIN_OPEN, sizeof(gpio[p].drive));	// What drives the pins outlives a reset
+		}
+	}
+	for (uint8_t i = 0; i < TIM_COUNT; i++)
+	{
+		tims[i].phase = 0;
+		tims[i].psc = 0;
+		tims[i].psc_cnt = 0;
+		tims[i].cnt = 0;
+	}
+	memset(dma, 0, sizeof(dma));
+	memset(&adc, 0, sizeof(adc));
+	memset(&uart, 0, sizeof(uart));
+	servo.moving = false;
+	if (power_on)
+	{
+		servo.pos = VALVE_PULSE_CLOSED;		// Shipped closed, the first opening starts from there
+		servo.target = VALVE_PULSE_CLOSED;
+		memset(bkp, 0, sizeof(bkp));
+		memset(&rtc, 0, sizeof(rtc));
+		batt_mv = 6000;
+		batt_mohm = 400;
+		vdda_mv = 3300;
+		console_len = 0;
+		console[0] = '\0';
+	}
+	rtc.hrtc = NULL;
+	rtc.alarm_on = false;
+	rtc.alarm_flag = false;
+	rtc.alarm_at = SIM_NEVER;
+	gpio_scan(false);
+}
+
+// Function to take the register writes of the firmware
+void periph_sync(void)
+{
+	gpio_sync();
+	for (uint8_t i = 0; i < TIM_COUNT; i++)
+	{
+		tim_sync(&tims[i]);
+	}
+	if (uart.tx != NULL && !uart.tx_glitch && uart_bit() != uart.tx_bit)
+	{
+		uart.tx_glitch = true;				// Bytes on the wire at a wrong bit time
+		uart.glitches++;
+	}
+}
+
+// Function to get the cycles to the next peripheral event
+uint64_t periph_next(void)
+{
+	uint64_t next = rtc_next();
+	for (uint8_t i = 0; i < TIM_COUNT; i++)
+	{
+		uint64_t t = tim_next(&tims[i]);
+		next = (t < next) ? t : next;
+	}
+	if (adc.converting && !sim_stopped)
+	{
+		uint64_t t = sim_after(adc.phase, adc.left, sim_pclk_div());
+		next = (t < next) ? t : next;
+	}
+	uint64_t t = uart_next();
+	return (t < next) ? t : next;
+}
+
+// Function to let the peripherals run up to their next event
+void periph_step(uint64_t cycles)
+{
+	uint64_t now = sim_now + cycles;
+	for (uint8_t i = 0; i < TIM_COUNT; i++)
+	{
+		tim_step(&tims[i], cycles);
+	}
+	if (adc.converting && !sim_stopped)
+	{
+		uint64_t edges = sim_edges(&adc.phase, cycles, sim_pclk_div());
+		if (edges >= adc.left)
+		{
+			adc_convert();
+		}
+		else
+		{
+			adc.left -= edges;
+		}
+	}
+	uart_step(cycles);
+	if (now >= rtc.alarm_at)
+	{
+		rtc.alarm_flag = true;
+		rtc_schedule(now);
+	}
+}
+
+// Function to get the interrupt request line of a peripheral
+bool periph_irq(IRQn_Type irq)
+{
+	uint32_t exti = (EXTI->RPR1 | EXTI->FPR1) & EXTI->IMR1;
+	switch (irq)
+	{
+	case EXTI0_1_IRQn:
+		return exti & 0x0003;
+	case EXTI2_3_IRQn:
+		return exti & 0x000C;
+	case EXTI4_15_IRQn:
+		return exti & 0xFFF0;
+	case TIM3_IRQn:
+	case TIM14_IRQn:
+	case TIM16_IRQn:
+	{
+		TIM_TypeDef *tim = tim_state((irq == TIM3_IRQn) ? TIM3 : (irq == TIM14_IRQn) ? TIM14 : TIM16)->tim;
+		return (tim->SR & TIM_SR_UIF) && (tim->DIER & TIM_DIER_UIE);
+	}
+	case DMA1_Channel1_IRQn:
+		return dma_irq(0);
+	case DMA1_Channel2_3_IRQn:
+		return dma_irq(1) || dma_irq(2);
+	case ADC1_IRQn:
+		return (ADC1->ISR & ADC_ISR_AWD1) && (ADC1->IER & ADC_IER_AWD1IE);
+	case USART2_IRQn:
+		return uart.tx_done || uart.rx_done;
+	case RTC_IRQn:
+		return rtc.alarm_flag && rtc.hrtc != NULL;
+	default:
+		return false;
+	}
+}
+
+// Function to drive an input pin from outside the board
+void host_set_pin(GPIO_TypeDef *port, uint16_t pin, host_pin_t drive)
+{
+	uint8_t p = gpio_index(port);
+	for (uint8_t i = 0; i < 16; i++)
+	{
+		if (pin & (1u << i))
+		{
+			gpio[p].drive[i] = (uint8_t)drive;
+		}
+	}
+	gpio_scan(true);
+	sim_sync();
+}
+
+// Function to read the level the firmware drives on an output
+bool host_pin_out(GPIO_TypeDef *port, uint16_t pin)
+{
+	return gpio_out(port, pin);
+}
+
+// Function to set the battery pack seen through the divider
+void host_set_battery(uint16_t mv, uint16_t mohm)
+{
+	batt_mv = mv;
+	batt_mohm = mohm;
+}
+
+// Function to set the analog supply
+void host_set_vdda(uint16_t mv)
+{
+	vdda_mv = mv;
+}
+
+// Function to get the servo position
+uint16_t host_servo_pulse(void)
+{
+	return servo.pos;
+}
+
+// Function to check whether the servo is powered
+bool host_servo_powered(void)
+{
+	return gpio_out(SERVO_POWER_GPIO_Port, SERVO_POWER_Pin);
+}
+
+// Function to receive a console byte, lost unless the firmware is listening
+void host_uart_rx(uint8_t byte)
+{
+	UART_HandleTypeDef *h = uart.huart;
+	if (h == NULL || h->RxState != HAL_UART_STATE_BUSY_RX || sim_stopped)
+	{
+		return;
+	}
+	*h->pRxBuffPtr++ = byte;
+	if (--h->RxXferCount == 0)
+	{
+		uart.rx_done = true;
+	}
+	sim_sync();
+}
+
+// Function to get the console output
+const char *host_console(void)
+{
+	return console;
+}
+
+// Function to forget the console output
+void host_console_clear(void)
+{
+	console_len = 0;
+	console[0] = '\0';
+}
+
+// Function to get the number of UART blocks whose bit time changed on the wire
+uint32_t host_uart_glitches(void)
+{
+	return uart.glitches;
+}
+
+// Function to configure pins as HAL_GPIO_Init does
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, const GPIO_InitTypeDef *pGPIO_Init)
+{
+	uint8_t p = gpio_index(GPIOx);
+	uint32_t mode = pGPIO_Init->Mode;
+	for (uint8_t pin = 0; pin < 16; pin++)
+	{
+		uint32_t line = 1u << pin;
+		if (!(pGPIO_Init->Pin & line))
+		{
+			continue;
+		}
+		if ((mode & GPIO_MODE_MASK) == GPIO_MODER_OUTPUT || (mode & GPIO_MODE_MASK) == GPIO_MODER_AF)
+		{
+			MODIFY_REG(GPIOx->OTYPER, line, ((mode & GPIO_OUTPUT_OD) ? 1u : 0u) << pin);
+			MODIFY_REG(GPIOx->OSPEEDR, 3u << (pin * 2), pGPIO_Init->Speed << (pin * 2));
+		}
+		if ((mode & GPIO_MODE_MASK) != GPIO_MODER_ANALOG)
+		{
+			MODIFY_REG(GPIOx->PUPDR, 3u << (pin * 2), pGPIO_Init->Pull << (pin * 2));
+		}
+		if ((mode & GPIO_MODE_MASK) == GPIO_MODER_AF)
+		{
+			MODIFY_REG(GPIOx->AFR[pin >> 3], 0xFu << ((pin & 7) * 4), pGPIO_Init->Alternate << ((pin & 7) * 4));
+		}
+		MODIFY_REG(GPIOx->MODER, 3u << (pin * 2), (mode & GPIO_MODE_MASK) << (pin * 2));
+		if (mode & GPIO_EXTI_MODE)
+		{
+			MODIFY_REG(EXTI->EXTICR[pin >> 2], 0xFFu << ((pin & 3) * 8), (uint32_t)p << ((pin & 3) * 8));
+			MODIFY_REG(EXTI->RTSR1, line, (mode & GPIO_EXTI_RISING) ? line : 0);
+			MODIFY_REG(EXTI->FTSR1, line, (mode & GPIO_EXTI_FALLING) ? line : 0);
+			MODIFY_REG(EXTI->IMR1, line, (mode & GPIO_EXTI_IT) ? line : 0);
+			MODIFY_REG(EXTI->EMR1, line, (mode & GPIO_EXTI_EVT) ? line : 0);
+		}
+	}
+	gpio_scan(false);
+}
+
+// Function to return pins to analog and release their EXTI lines
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin)
+{
+	uint8_t p = gpio_index(GPIOx);
+	for (uint8_t pin = 0; pin < 16; pin++)
+	{
+		uint32_t line = 1u << pin;
+		if (!(GPIO_Pin & line))
+		{
+			continue;
+		}
+		if (((EXTI->EXTICR[pin >> 2] >> ((pin & 3) * 8)) & 0xFF) == p)
+		{
+			CLEAR_BIT(EXTI->IMR1, line);
+			CLEAR_BIT(EXTI->EMR1, line);
+			CLEAR_BIT(EXTI->RTSR1, line);
+			CLEAR_BIT(EXTI->FTSR1, line);
+		}
+		SET_BIT(GPIOx->MODER, 3u << (pin * 2));
+		CLEAR_BIT(GPIOx->PUPDR, 3u << (pin * 2));
+	}
+	gpio_scan(false);
+}
+
+// Function to read an input pin
+GPIO_PinState HAL_GPIO_ReadPin(const GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	sim_sync();
+	return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+// Function to drive output pins
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	if (PinState != GPIO_PIN_RESET)
+	{
+		GPIOx->BSRR = GPIO_Pin;
+	}
+	else
+	{
+		GPIOx->BRR = GPIO_Pin;
+	}
+	sim_sync();
+}
+
+// Function to serve the EXTI flags of a line, rising edge first
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin)
+{
+	if (EXTI->RPR1 & GPIO_Pin)
+	{
+		EXTI->RPR1 &= ~(uint32_t)GPIO_Pin;
+		HAL_GPIO_EXTI_Rising_Callback(GPIO_Pin);
+	}
+	if (EXTI->FPR1 & GPIO_Pin)
+	{
+		EXTI->FPR1 &= ~(uint32_t)GPIO_Pin;
+		HAL_GPIO_EXTI_Falling_Callback(GPIO_Pin);
+	}
+}
+
+// Function to set the HSI divider
+HAL_StatusTypeDef HAL_RCC_OscConfig(const RCC_OscInitTypeDef *RCC_OscInitStruct)
+{
+	if (RCC_OscInitStruct->OscillatorType & RCC_OSCILLATORTYPE_HSI)
+	{
+		__HAL_RCC_HSI_CONFIG(RCC_OscInitStruct->HSIDiv);
+	}
+	if (RCC_OscInitStruct->LSIState == RCC_LSI_ON)
+	{
+		SET_BIT(RCC->CSR2, RCC_CSR2_LSION | RCC_CSR2_LSIRDY);
+	}
+	SystemCoreClock = SIM_HSI_HZ / sim_hclk_div();
+	return HAL_OK;
+}
+
+// Function to set the flash latency and the APB divider, then restart the tick for the new clock
+HAL_StatusTypeDef HAL_RCC_ClockConfig(const RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency)
+{
+	__HAL_FLASH_SET_LATENCY(FLatency);
+	if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_PCLK1)
+	{
+		MODIFY_REG(RCC->CFGR, RCC_CFGR_PPRE, RCC_ClkInitStruct->APB1CLKDivider);
+	}
+	SystemCoreClock = SIM_HSI_HZ / sim_hclk_div();
+	return HAL_InitTick(uwTickPrio);
+}
+
+// Function to get the PCLK frequency
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return SIM_HSI_HZ / sim_pclk_div();
+}
+
+// Function to select peripheral kernel clocks, every kernel runs from the bus clock here
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(const RCC_PeriphCLKInitTypeDef *PeriphClkInit)
+{
+	return HAL_OK;
+}
+
+// Function to read a backup register
+uint32_t HAL_PWREx_BKUPRead(uint32_t BackupRegister)
+{
+	return bkp[BackupRegister];
+}
+
+// Function to write a backup register
+void HAL_PWREx_BKUPWrite(uint32_t BackupRegister, uint16_t Data)
+{
+	bkp[BackupRegister] = Data;
+}
+
+// Function to initialise a DMA channel
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+	dma_state_t *d = &dma[dma_index(hdma->Instance)];
+	d->hdma = hdma;
+	d->on = false;
+	hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+	hdma->State = HAL_DMA_STATE_READY;
+	hdma->Lock = HAL_UNLOCKED;
+	return HAL_OK;
+}
+
+// Function to release a DMA channel
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma)
+{
+	dma[dma_index(hdma->Instance)].on = false;
+	hdma->State = HAL_DMA_STATE_RESET;
+	return HAL_OK;
+}
+
+// Function to start a DMA transfer with its interrupts, half transfer only with a callback for it
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength)
+{
+	if (hdma->State != HAL_DMA_STATE_READY)
+	{
+		return HAL_BUSY;
+	}
+	dma_state_t *d = &dma[dma_index(hdma->Instance)];
+	hdma->State = HAL_DMA_STATE_BUSY;
+	hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+	d->hdma = hdma;
+	d->mem = (hdma->Init.Direction == DMA_MEMORY_TO_PERIPH) ? SrcAddress : DstAddress;
+	d->len = (uint16_t)DataLength;
+	d->left = (uint16_t)DataLength;
+	d->ht = false;
+	d->tc = false;
+	d->ht_ie = hdma->XferHalfCpltCallback != NULL;
+	d->tc_ie = true;
+	d->on = true;
+	hdma->Instance->CNDTR = DataLength;
+	return HAL_OK;
+}
+
+// Function to stop a DMA transfer, CNDTR keeps the transfers left
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+	if (hdma->State != HAL_DMA_STATE_BUSY)
+	{
+		hdma->ErrorCode = HAL_DMA_ERROR_NO_XFER;
+		return HAL_ERROR;
+	}
+	dma_state_t *d = &dma[dma_index(hdma->Instance)];
+	d->on = false;
+	d->ht = false;
+	d->tc = false;
+	d->ht_ie = false;
+	d->tc_ie = false;
+	hdma->State = HAL_DMA_STATE_READY;
+	return HAL_OK;
+}
+
+// Function to serve the flags of a DMA channel and call the transfer callbacks
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma)
+{
+	dma_state_t *d = &dma[dma_index(hdma->Instance)];
+	bool circular = hdma->Init.Mode == DMA_CIRCULAR;
+	if (d->ht && d->ht_ie)
+	{
+		d->ht = false;
+		d->ht_ie = circular;
+		if (hdma->XferHalfCpltCallback != NULL)
+		{
+			hdma->XferHalfCpltCallback(hdma);
+		}
+	}
+	if (d->tc && d->tc_ie)
+	{
+		d->tc = false;
+		if (!circular)
+		{
+			d->ht_ie = false;
+			d->tc_ie = false;
+			d->on = false;
+			hdma->State = HAL_DMA_STATE_READY;
+		}
+		if (hdma->XferCpltCallback != NULL)
+		{
+			hdma->XferCpltCallback(hdma);
+		}
+	}
+}
+
+// Function to initialise a timer time base
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim)
+{
+	if (htim->State == HAL_TIM_STATE_RESET)
+	{
+		htim->Lock = HAL_UNLOCKED;
+		HAL_TIM_Base_MspInit(htim);
+	}
+	tim_setup(htim);
+	return HAL_OK;
+}
+
+// Function to initialise a timer for PWM
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim)
+{
+	if (htim->State == HAL_TIM_STATE_RESET)
+	{
+		htim->Lock = HAL_UNLOCKED;
+		HAL_TIM_PWM_MspInit(htim);
+	}
+	tim_setup(htim);
+	return HAL_OK;
+}
+
+// Function to select the trigger output of a timer
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, const TIM_MasterConfigTypeDef *sMasterConfig)
+{
+	MODIFY_REG(htim->Instance->CR2, TIM_CR2_MMS, sMasterConfig->MasterOutputTrigger);
+	MODIFY_REG(htim->Instance->SMCR, TIM_SMCR_MSM, sMasterConfig->MasterSlaveMode);
+	return HAL_OK;
+}
+
+// Function to configure channel 1 as a preloaded PWM output, the only channel the firmware uses
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, const TIM_OC_InitTypeDef *sConfig, uint32_t Channel)
+{
+	TIM_TypeDef *tim = htim->Instance;
+	MODIFY_REG(tim->CCMR1, TIM_CCMR1_OC1M | TIM_CCMR1_OC1PE, sConfig->OCMode | TIM_CCMR1_OC1PE);
+	MODIFY_REG(tim->CCER, TIM_CCER_CC1P, sConfig->OCPolarity);
+	tim->CCR1 = sConfig->Pulse;
+	return HAL_OK;
+}
+
+// Function to enable or disable a capture compare channel
+void TIM_CCxChannelCmd(TIM_TypeDef *TIMx, uint32_t Channel, uint32_t ChannelState)
+{
+	uint32_t bit = TIM_CCER_CC1E << (Channel & 0x1FU);
+	TIMx->CCER &= ~bit;
+	TIMx->CCER |= ChannelState << (Channel & 0x1FU);
+}
+
+// Function to start the PWM output and the counter
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+	TIM_CCxChannelCmd(htim->Instance, Channel, TIM_CCx_ENABLE);
+	htim->ChannelState[Channel >> 2] = HAL_TIM_CHANNEL_STATE_BUSY;
+	SET_BIT(htim->Instance->CR1, TIM_CR1_CEN);
+	return HAL_OK;
+}
+
+// Function to stop the PWM output and the counter
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+	TIM_CCxChannelCmd(htim->Instance, Channel, TIM_CCx_DISABLE);
+	htim->ChannelState[Channel >> 2] = HAL_TIM_CHANNEL_STATE_READY;
+	CLEAR_BIT(htim->Instance->CR1, TIM_CR1_CEN);
+	return HAL_OK;
+}
+
+// Function to start a time base with its update interrupt
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim)
+{
+	if (htim->State != HAL_TIM_STATE_READY)
+	{
+		return HAL_ERROR;
+	}
+	htim->State = HAL_TIM_STATE_BUSY;
+	SET_BIT(htim->Instance->DIER, TIM_DIER_UIE);
+	SET_BIT(htim->Instance->CR1, TIM_CR1_CEN);
+	sim_sync();
+	return HAL_OK;
+}
+
+// Function to stop a time base and its update interrupt
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim)
+{
+	CLEAR_BIT(htim->Instance->DIER, TIM_DIER_UIE);
+	CLEAR_BIT(htim->Instance->CR1, TIM_CR1_CEN);
+	htim->State = HAL_TIM_STATE_READY;
+	return HAL_OK;
+}
+
+// Function to serve the update interrupt of a timer
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef *htim)
+{
+	TIM_TypeDef *tim = htim->Instance;
+	if ((tim->SR & TIM_SR_UIF) && (tim->DIER & TIM_DIER_UIE))
+	{
+		tim->SR &= ~TIM_SR_UIF;
+		HAL_TIM_PeriodElapsedCallback(htim);
+	}
+}
+
+// Function to initialise the ADC, the ranks are set by HAL_ADC_ConfigChannel
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *hadc)
+{
+	if (hadc->State == HAL_ADC_STATE_RESET)
+	{
+		hadc->Lock = HAL_UNLOCKED;
+		HAL_ADC_MspInit(hadc);
+	}
+	adc.hadc = hadc;
+	adc.started = false;
+	adc.converting = false;
+	hadc->ErrorCode = HAL_ADC_ERROR_NONE;
+	hadc->State = HAL_ADC_STATE_READY;
+	return HAL_OK;
+}
+
+// Function to set the channel of a sequencer rank
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc, ADC_ChannelConfTypeDef *sConfig)
+{
+	uint32_t rank = sConfig->Rank / (ADC_REGULAR_RANK_2 - ADC_REGULAR_RANK_1);
+	if (rank < ADC_RANKS)
+	{
+		adc.ranks[rank] = sConfig->Channel;
+	}
+	return HAL_OK;
+}
+
+// Function to set analog watchdog 1, only the low threshold is modelled
+HAL_StatusTypeDef HAL_ADC_AnalogWDGConfig(ADC_HandleTypeDef *hadc, ADC_AnalogWDGConfTypeDef *AnalogWDGConfig)
+{
+	adc.awd = AnalogWDGConfig->WatchdogMode != ADC_ANALOGWATCHDOG_NONE;
+	adc.awd_low = AnalogWDGConfig->LowThreshold;
+	MODIFY_REG(ADC1->IER, ADC_IER_AWD1IE, (adc.awd && AnalogWDGConfig->ITMode == ENABLE) ? ADC_IER_AWD1IE : 0);
+	CLEAR_BIT(ADC1->ISR, ADC_ISR_AWD1);
+	return HAL_OK;
+}
+
+// Function to calibrate the ADC, the model has no offset
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc)
+{
+	return HAL_OK;
+}
+
+// Function to pass the end of the DMA transfer to the ADC callback
+static void adc_dma_complete(DMA_HandleTypeDef *hdma)
+{
+	HAL_ADC_ConvCpltCallback((ADC_HandleTypeDef *)hdma->Parent);
+}
+
+// Function to pass the half transfer to the ADC callback
+static void adc_dma_half(DMA_HandleTypeDef *hdma)
+{
+	HAL_ADC_ConvHalfCpltCallback((ADC_HandleTypeDef *)hdma->Parent);
+}
+
+// Function to pass a DMA error to the ADC callback
+static void adc_dma_error(DMA_HandleTypeDef *hdma)
+{
+	HAL_ADC_ErrorCallback((ADC_HandleTypeDef *)hdma->Parent);
+}
+
+// Function to start the sequence with DMA, at once or on the external trigger
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length)
+{
+	if (adc.started)
+	{
+		return HAL_BUSY;
+	}
+	hadc->DMA_Handle->XferCpltCallback = adc_dma_complete;
+	hadc->DMA_Handle->XferHalfCpltCallback = adc_dma_half;
+	hadc->DMA_Handle->XferErrorCallback = adc_dma_error;
+	if (HAL_DMA_Start_IT(hadc->DMA_Handle, (uint32_t)(uintptr_t)&ADC1->DR, (uint32_t)(uintptr_t)pData, Length) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+	CLEAR_BIT(ADC1->ISR, ADC_ISR_EOS | ADC_ISR_AWD1);
+	adc.started = true;
+	hadc->State = HAL_ADC_STATE_REG_BUSY;
+	if (hadc->Init.ExternalTrigConv == ADC_SOFTWARE_START)
+	{
+		adc_sequence();
+		sim_sync();
+	}
+	return HAL_OK;
+}
+
+// Function to stop the conversions and the DMA transfer
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc)
+{
+	adc.started = false;
+	adc.converting = false;
+	if (hadc->DMA_Handle->State == HAL_DMA_STATE_BUSY)
+	{
+		HAL_DMA_Abort(hadc->DMA_Handle);
+	}
+	hadc->State = HAL_ADC_STATE_READY;
+	return HAL_OK;
+}
+
+// Function to serve the analog watchdog interrupt
+void HAL_ADC_IRQHandler(ADC_HandleTypeDef *hadc)
+{
+	if ((ADC1->ISR & ADC_ISR_AWD1) && (ADC1->IER & ADC_IER_AWD1IE))
+	{
+		ADC1->ISR &= ~ADC_ISR_AWD1;
+		HAL_ADC_LevelOutOfWindowCallback(hadc);
+	}
+}
+
+// Function to initialise the UART, the bit time follows PCLK as the HAL computes it
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+	if (huart->gState == HAL_UART_STATE_RESET)
+	{
+		huart->Lock = HAL_UNLOCKED;
+		HAL_UART_MspInit(huart);
+	}
+	uart.huart = huart;
+	huart->Instance->BRR = UART_DIV_SAMPLING16(HAL_RCC_GetPCLK1Freq(), huart->Init.BaudRate, huart->Init.ClockPrescaler);
+	huart->Instance->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
+	huart->Instance->ISR = USART_ISR_TC | USART_ISR_TXE_TXFNF;
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+// Function to arm the reception of a number of bytes
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+	if (huart->RxState != HAL_UART_STATE_READY)
+	{
+		return HAL_BUSY;
+	}
+	huart->pRxBuffPtr = pData;
+	huart->RxXferSize = Size;
+	huart->RxXferCount = Size;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	return HAL_OK;
+}
+
+// Function to send a block by DMA, TC clears until its last stop bit has left
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+	if (huart->gState != HAL_UART_STATE_READY)
+	{
+		return HAL_BUSY;
+	}
+	huart->gState = HAL_UART_STATE_BUSY_TX;
+	huart->Instance->ISR &= ~USART_ISR_TC;
+	uart.tx = pData;
+	uart.tx_len = Size;
+	uart.tx_bit = uart_bit();
+	uart.tx_left = (uint64_t)Size * 10 * uart.tx_bit;
+	uart.tx_glitch = false;
+	return HAL_OK;
+}
+
+// Function to serve the end of a transmission and of a reception
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart)
+{
+	if (uart.rx_done)
+	{
+		uart.rx_done = false;
+		huart->RxState = HAL_UART_STATE_READY;
+		HAL_UART_RxCpltCallback(huart);
+	}
+	if (uart.tx_done)
+	{
+		uart.tx_done = false;
+		huart->gState = HAL_UART_STATE_READY;
+		HAL_UART_TxCpltCallback(huart);
+	}
+}
+
+// Function to convert a binary value to BCD
+uint8_t RTC_ByteToBcd2(uint8_t Value)
+{
+	return (uint8_t)(((Value / 10) << 4) | (Value % 10));
+}
+
+// Function to convert a BCD value to binary
+uint8_t RTC_Bcd2ToByte(uint8_t Value)
+{
+	return (uint8_t)((Value >> 4) * 10 + (Value & 0x0F));
+}
+
+// Function to initialise the RTC, the calendar keeps running
+HAL_StatusTypeDef HAL_RTC_Init(RTC_HandleTypeDef *hrtc)
+{
+	if (hrtc->State == HAL_RTC_STATE_RESET)
+	{
+		hrtc->Lock = HAL_UNLOCKED;
+		HAL_RTC_MspInit(hrtc);
+	}
+	rtc.hrtc = hrtc;
+	hrtc->State = HAL_RTC_STATE_READY;
+	return HAL_OK;
+}
+
+// Function to set the time of day, the subseconds restart
+HAL_StatusTypeDef HAL_RTC_SetTime(RTC_HandleTypeDef *hrtc, RTC_TimeTypeDef *sTime, uint32_t Format)
+{
+	uint8_t h = sTime->Hours, m = sTime->Minutes, s = sTime->Seconds;
+	if (Format == RTC_FORMAT_BCD)
+	{
+		h = RTC_Bcd2ToByte(h);
+		m = RTC_Bcd2ToByte(m);
+		s = RTC_Bcd2ToByte(s);
+	}
+	uint32_t day = rtc_seconds_at(sim_now) / 86400;
+	rtc.base_s = day * 86400 + ((uint32_t)h * 60 + m) * 60 + s;
+	rtc.base_t = sim_now;
+	rtc_schedule(sim_now);
+	return HAL_OK;
+}
+
+// Function to set the date, the time of day is kept
+HAL_StatusTypeDef HAL_RTC_SetDate(RTC_HandleTypeDef *hrtc, RTC_DateTypeDef *sDate, uint32_t Format)
+{
+	uint8_t y = sDate->Year, m = sDate->Month, d = sDate->Date;
+	if (Format == RTC_FORMAT_BCD)
+	{
+		y = RTC_Bcd2ToByte(y);
+		m = RTC_Bcd2ToByte(m);
+		d = RTC_Bcd2ToByte(d);
+	}
+	uint32_t days = y * 365u + (y + 3u) / 4 + month_days[m - 1] + d - 1;
+	if ((y % 4) == 0 && m > 2)
+	{
+		days++;
+	}
+	uint32_t now = rtc_seconds_at(sim_now);
+	rtc.base_s += days * 86400 + now % 86400 - now;
+	rtc_schedule(sim_now);
+	return HAL_OK;
+}
+
+// Function to read the time of day and the subsecond down counter
+HAL_StatusTypeDef HAL_RTC_GetTime(RTC_HandleTypeDef *hrtc, RTC_TimeTypeDef *sTime, uint32_t Format)
+{
+	uint32_t s = rtc_seconds_at(sim_now) % 86400;
+	uint64_t frac = (sim_now - rtc.base_t) % SIM_HSI_HZ;
+	uint32_t prediv = hrtc->Init.SynchPrediv;
+	sTime->Hours = (uint8_t)(s / 3600);
+	sTime->Minutes = (uint8_t)((s / 60) % 60);
+	sTime->Seconds = (uint8_t)(s % 60);
+	sTime->TimeFormat = RTC_HOURFORMAT12_AM;
+	sTime->SubSeconds = prediv - (uint32_t)(frac * (prediv + 1) / SIM_HSI_HZ);
+	sTime->SecondFraction = prediv;
+	if (Format == RTC_FORMAT_BCD)
+	{
+		sTime->Hours = RTC_ByteToBcd2(sTime->Hours);
+		sTime->Minutes = RTC_ByteToBcd2(sTime->Minutes);
+		sTime->Seconds = RTC_ByteToBcd2(sTime->Seconds);
+	}
+	return HAL_OK;
+}
+
+// Function to read the date
+HAL_StatusTypeDef HAL_RTC_GetDate(RTC_HandleTypeDef *hrtc, RTC_DateTypeDef *sDate, uint32_t Format)
+{
+	uint32_t days = rtc_seconds_at(sim_now) / 86400;
+	rtc_date(days, &sDate->Year, &sDate->Month, &sDate->Date);
+	sDate->WeekDay = (uint8_t)((days + 5) % 7 + 1);	// 2000-01-01 was a Saturday
+	if (Format == RTC_FORMAT_BCD)
+	{
+		sDate->Year = RTC_ByteToBcd2(sDate->Year);
+		sDate->Month = RTC_ByteToBcd2(sDate->Month);
+		sDate->Date = RTC_ByteToBcd2(sDate->Date);
+	}
+	return HAL_OK;
+}
+
+// Function to program Alarm A with its interrupt
+HAL_StatusTypeDef HAL_RTC_SetAlarm_IT(RTC_HandleTypeDef *hrtc, RTC_AlarmTypeDef *sAlarm, uint32_t Format)
+{
+	rtc.alarm = *sAlarm;
+	if (Format == RTC_FORMAT_BCD)
+	{
+		rtc.alarm.AlarmTime.Hours = RTC_Bcd2ToByte(sAlarm->AlarmTime.Hours);
+		rtc.alarm.AlarmTime.Minutes = RTC_Bcd2ToByte(sAlarm->AlarmTime.Minutes);
+		rtc.alarm.AlarmTime.Seconds = RTC_Bcd2ToByte(sAlarm->AlarmTime.Seconds);
+		rtc.alarm.AlarmDateWeekDay = RTC_Bcd2ToByte(sAlarm->AlarmDateWeekDay);
+	}
+	rtc.alarm_on = true;
+	rtc.alarm_flag = false;
+	rtc_schedule(sim_now);
+	return HAL_OK;
+}
+
+// Function to serve the Alarm A interrupt
+void HAL_RTC_AlarmIRQHandler(RTC_HandleTypeDef *hrtc)
+{
+	if (rtc.alarm_flag)
+	{
+		rtc.alarm_flag = false;
+		HAL_RTC_AlarmAEventCallback(hrtc);
+	}
+	hrtc->State = HAL_RTC_STATE_READY;
+}
+
+// Function to read the calendar without the shadow registers, always the case here
+HAL_StatusTypeDef HAL_RTCEx_EnableBypassShadow(RTC_HandleTypeDef *hrtc)
+{
+	return HAL_OK;
+}
+
+// Function to select the calibration output, the pin is not modelled
+HAL_StatusTypeDef HAL_RTCEx_SetCalibrationOutPut(RTC_HandleTypeDef *hrtc, uint32_t CalibOutput)
+{
+	return HAL_OK;
+}
@@ -0,0 +1,52 @@
+// Host simulation harness for the flood guard firmware.
+// The App and Cube sources run unchanged on a simulated STM32C031: the HAL calls
+// they make are stubbed by peripheral models (stub/hal_stub.c) and time is virtual,
+// counted in HSI48 cycles (stub/sim.c). It only moves while a test runs the
+// firmware or advances it, so days of battery or flood scenarios take seconds.
+// A test either calls modules directly after host_reset, or boots the firmware
+// with host_boot and drives its inputs between host_run_ms steps.
+
+#ifndef HOST_H
+#define HOST_H
+
+#include "main.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Check a condition, report the failing line and count it
+#define CHECK(cond)	do { if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); host_failures++; } } while (0)
+
+// External drive of an input pin
+typedef enum
+{
+	HOST_PIN_OPEN = 0,						// Nothing connected, the pin follows its pull
+	HOST_PIN_HIGH,							// Driven high, e.g. a released button or a short to the supply
+	HOST_PIN_LOW,							// Driven low, e.g. a pressed button or a short to ground
+	HOST_PIN_WET							// Water between the probe and ground, beats a pull-up but not a driven pin
+} host_pin_t;
+
+extern int host_failures;					// Failed checks of the running test
+
+void host_reset(void);						// Power on, HAL_Init done, time 0, backup registers cleared
+void host_boot(void);						// Run the firmware from reset until it first sleeps, once per process
+void host_run_us(uint64_t us);				// Let the firmware run, returns once it sleeps at or after the time
+void host_run_ms(uint64_t ms);				// Same in milliseconds
+void host_advance_us(uint64_t us);			// Same as host_run_us, also moves time without a booted firmware
+void host_advance_ms(uint64_t ms);			// Same in milliseconds
+uint64_t host_time_us(void);				// Virtual time since host_reset
+int host_scenario(const char *name, void (*run)(void));	// Run a scenario in its own process from power on, returns its failures
+int host_result(const char *name);			// Print the verdict of a test, returns the process exit code
+
+void host_set_pin(GPIO_TypeDef *port, uint16_t pin, host_pin_t drive);	// Drive an input from outside
+bool host_pin_out(GPIO_TypeDef *port, uint16_t pin);	// Level the firmware drives on an output
+void host_set_battery(uint16_t mv, uint16_t mohm);	// Open circuit voltage and internal resistance of the pack
+void host_set_vdda(uint16_t mv);			// Analog supply seen through VREFINT
+uint16_t host_servo_pulse(void);			// Servo position as the TIM3 compare value it follows
+bool host_servo_powered(void);				// Servo supply switched on by PA9
+void host_uart_rx(uint8_t byte);			// Receive a console byte, lost unless reception is armed
+const char *host_console(void);				// Everything the firmware sent on USART2
+void host_console_clear(void);				// Forget the console output so far
+uint32_t host_uart_glitches(void);			// Transfers whose bit time changed on the wire
+bool host_stopped(void);					// Core in STOP
+
+#endif /* HOST_H */
@@ -0,0 +1,41 @@
+// Host stand-in for the CMSIS compiler layer (cmsis_compiler.h).
+// Defines its guard so core_cm0plus.h never sees the ARM inline assembly, the
+// interrupt mask, WFI and barriers map to the simulator in stub/sim.c.
+
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#define __ASM					__asm
+#define __INLINE				inline
+#define __STATIC_INLINE			static inline
+#define __STATIC_FORCEINLINE	static inline __attribute__((always_inline))
+#define __NO_RETURN				__attribute__((__noreturn__))
+#define __USED					__attribute__((used))
+#define __WEAK					__attribute__((weak))
+#define __PACKED				__attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT			struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION			union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x)			__attribute__((aligned(x)))
+#define __RESTRICT				__restrict
+#define __COMPILER_BARRIER()	__asm volatile("" ::: "memory")
+
+extern uint32_t host_primask;				// PRIMASK image, 1 while interrupts are masked
+
+void host_irq_set(uint32_t primask);		// Change PRIMASK, delivers what became unmasked
+void host_wfi(void);						// SLEEP until an interrupt is pending
+
+#define __NOP()					do { } while (0)
+#define __WFI()					host_wfi()
+#define __WFE()					host_wfi()
+#define __SEV()					do { } while (0)
+#define __ISB()					__COMPILER_BARRIER()
+#define __DSB()					__COMPILER_BARRIER()
+#define __DMB()					__COMPILER_BARRIER()
+#define __enable_irq()			host_irq_set(0)
+#define __disable_irq()			host_irq_set(1)
+#define __get_PRIMASK()			(host_primask)
+#define __set_PRIMASK(p)		host_irq_set(p)
+
+#endif /* __CMSIS_COMPILER_H */
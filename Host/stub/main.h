@@ -0,0 +1,23 @@
+// Host stand-in for Core/Inc/main.h.
+// Swaps the CMSIS compiler layer for the simulator, then includes the board
+// main.h by its path, so the application and the Cube sources compile on Linux unchanged.
+// The registers live at their target addresses, mapped by stub/sim.c.
+
+#ifndef HOST_MAIN_H
+#define HOST_MAIN_H
+
+#include "host_cmsis.h"
+#include "../../Core/Inc/main.h"
+
+// Plain memory cannot clear on a write of one, so the write one to clear and the
+// write zero to clear flags are rewritten as the clears they stand for
+#undef __HAL_GPIO_EXTI_CLEAR_RISING_IT
+#undef __HAL_GPIO_EXTI_CLEAR_FALLING_IT
+#undef __HAL_TIM_CLEAR_FLAG
+#undef __HAL_TIM_CLEAR_IT
+#define __HAL_GPIO_EXTI_CLEAR_RISING_IT(__EXTI_LINE__)		(EXTI->RPR1 &= ~(uint32_t)(__EXTI_LINE__))
+#define __HAL_GPIO_EXTI_CLEAR_FALLING_IT(__EXTI_LINE__)		(EXTI->FPR1 &= ~(uint32_t)(__EXTI_LINE__))
+#define __HAL_TIM_CLEAR_FLAG(__HANDLE__, __FLAG__)			((__HANDLE__)->Instance->SR &= ~(uint32_t)(__FLAG__))
+#define __HAL_TIM_CLEAR_IT(__HANDLE__, __INTERRUPT__)		((__HANDLE__)->Instance->SR &= ~(uint32_t)(__INTERRUPT__))
+
+#endif /* HOST_MAIN_H */
@@ -0,0 +1,668 @@
+// Program Description: Virtual clock, SysTick, interrupt controller and firmware context of the host simulator.
+
+#include "host.h"
+#include "sim.h"
+#include "stm32c0xx_it.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+
+#define SIM_STACK_SIZE		(256 * 1024)	// Firmware stack, the interrupt handlers nest on it as on the target
+#define SIM_TICK_READ		1				// HCLK cycles charged per HAL_GetTick call, busy waits move time on
+#define SIM_WAKE_STOP_US	6				// Wake up from STOP with the flash powered
+#define SIM_WAKE_DEEP_US	14				// Wake up from STOP with the flash powered down
+#define SIM_BUSY_LIMIT_S	10				// Virtual seconds the firmware may run past the target without sleeping
+#define SIM_THREAD			4				// Execution priority of thread mode, below every interrupt
+#define SIM_SYSTICK			32				// Slot of SysTick in the priority table, after the 32 IRQs
+#define SIM_VREFINT_CAL		1655			// Factory VREFINT reading at 3.0 V
+#define SIM_CYCLES_US		(SIM_HSI_HZ / 1000000)
+
+int board_main(void);						// main() of Core/Src/main.c, renamed by the build
+
+uint64_t sim_now;
+bool sim_stopped;
+uint32_t host_primask;
+int host_failures;
+
+__IO uint32_t uwTick;
+uint32_t uwTickPrio = (1UL << __NVIC_PRIO_BITS);
+HAL_TickFreqTypeDef uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+
+// Memory behind the register addresses the firmware uses
+typedef struct
+{
+	uintptr_t base;
+	size_t size;
+} sim_region_t;
+
+static const sim_region_t regions[] =
+{
+	{ APBPERIPH_BASE, 0x30000 },			// APB and AHB peripherals up to the flash interface
+	{ IOPORT_BASE, 0x2000 },				// GPIO ports
+	{ SCS_BASE, 0x1000 },					// SysTick, NVIC and SCB
+	{ 0x1FFF7000, 0x1000 },					// Engineering bytes holding VREFINT_CAL, kept by a reset
+};
+
+#define SIM_RESET_REGIONS	3				// Regions cleared by a reset
+
+// Interrupt handler of one exception, in exception number order
+typedef struct
+{
+	IRQn_Type irq;
+	void (*handler)(void);
+} sim_vector_t;
+
+static const sim_vector_t vectors[] =
+{
+	{ SysTick_IRQn, SysTick_Handler },
+	{ RTC_IRQn, RTC_IRQHandler },
+	{ EXTI0_1_IRQn, EXTI0_1_IRQHandler },
+	{ EXTI2_3_IRQn, EXTI2_3_IRQHandler },
+	{ EXTI4_15_IRQn, EXTI4_15_IRQHandler },
+	{ DMA1_Channel1_IRQn, DMA1_Channel1_IRQHandler },
+	{ DMA1_Channel2_3_IRQn, DMA1_Channel2_3_IRQHandler },
+	{ ADC1_IRQn, ADC1_IRQHandler },
+	{ TIM3_IRQn, TIM3_IRQHandler },
+	{ TIM14_IRQn, TIM14_IRQHandler },
+	{ TIM16_IRQn, TIM16_IRQHandler },
+	{ USART2_IRQn, USART2_IRQHandler },
+};
+
+#define SIM_VECTOR_COUNT	(sizeof(vectors) / sizeof(vectors[0]))
+
+static bool nvic_enabled[32];				// NVIC ISER image
+static uint8_t nvic_prio[SIM_SYSTICK + 1];	// Preemption priority of every IRQ and SysTick
+static uint8_t exec_prio;					// Priority of the running handler, SIM_THREAD in thread mode
+static bool tick_pending;					// SysTick exception pending
+static uint32_t st_val;						// SysTick counter as last written back to VAL
+static uint32_t st_phase;					// Cycles into the current SysTick clock period
+static bool st_cleared;						// VAL was written, the next reload raises no tick
+static bool flash_pd;						// Flash powered down in STOP
+
+static ucontext_t test_ctx;					// Test code, runs between the host_run steps
+static ucontext_t fw_ctx;					// Firmware, from reset to its sleeps
+static uint8_t fw_stack[SIM_STACK_SIZE] __attribute__((aligned(16)));
+static bool booted;							// The firmware owns the core, the test only drives inputs
+static bool in_fw;							// The firmware context is running
+static uint64_t run_until;					// End of the current host_run step
+static uint32_t fw_primask;					// PRIMASK of the parked firmware, the test runs with its own
+
+// Function to map the register regions before any test code runs
+__attribute__((constructor)) static void sim_map(void)
+{
+	for (uint8_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++)
+	{
+		void *p = mmap((void *)regions[i].base, regions[i].size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		if (p != (void *)regions[i].base)
+		{
+			fprintf(stderr, "host: cannot map the registers at 0x%08lx\n", (unsigned long)regions[i].base);
+			exit(2);
+		}
+	}
+	*(uint16_t *)VREFINT_CAL_ADDR = SIM_VREFINT_CAL;
+}
+
+// Function to get the HCLK divider of HSI48
+uint32_t sim_hclk_div(void)
+{
+	return 1u << ((RCC->CR & RCC_CR_HSIDIV) >> RCC_CR_HSIDIV_Pos);
+}
+
+// Function to get the APB divider of HCLK
+static uint32_t sim_apb_div(void)
+{
+	uint32_t ppre = (RCC->CFGR & RCC_CFGR_PPRE) >> RCC_CFGR_PPRE_Pos;
+	return (ppre < 4) ? 1 : 1u << (ppre - 3);
+}
+
+// Function to get the PCLK divider of HSI48
+uint32_t sim_pclk_div(void)
+{
+	return sim_hclk_div() * sim_apb_div();
+}
+
+// Function to get the timer clock divider of HSI48, the timers run at twice PCLK when the APB is divided
+uint32_t sim_timclk_div(void)
+{
+	uint32_t apb = sim_apb_div();
+	return sim_hclk_div() * ((apb > 1) ? apb / 2 : 1);
+}
+
+// Function to get the SysTick clock divider of HSI48
+static uint32_t systick_div(void)
+{
+	return (SysTick->CTRL & SysTick_CTRL_CLKSOURCE_Msk) ? sim_hclk_div() : sim_hclk_div() * 8;
+}
+
+// Function to check whether the SysTick counter runs, it stops with the core clock in STOP
+static bool systick_running(void)
+{
+	return !sim_stopped && (SysTick->CTRL & SysTick_CTRL_ENABLE_Msk);
+}
+
+// Function to get the SysTick period in counter clocks
+static uint64_t systick_period(void)
+{
+	return (uint64_t)(SysTick->LOAD & SysTick_LOAD_RELOAD_Msk) + 1;
+}
+
+// Function to take a write of VAL, any value clears the counter and the next reload raises no tick
+static void systick_sync(void)
+{
+	if (SysTick->VAL != st_val)
+	{
+		st_val = 0;
+		st_phase = 0;
+		st_cleared = true;
+		SysTick->VAL = 0;
+	}
+}
+
+// Function to get the cycles to the next SysTick reload
+static uint64_t systick_next(void)
+{
+	return systick_running() ? sim_after(st_phase, (uint64_t)st_val + 1, systick_div()) : SIM_NEVER;
+}
+
+// Function to count SysTick down, a reload with TICKINT pends the exception once however many passed
+static void systick_step(uint64_t cycles)
+{
+	if (!systick_running())
+	{
+		return;
+	}
+	uint64_t edges = sim_edges(&st_phase, cycles, systick_div());
+	if (edges > st_val)
+	{
+		edges = (edges - st_val - 1) % systick_period();
+		if (!st_cleared && (SysTick->CTRL & SysTick_CTRL_TICKINT_Msk))
+		{
+			tick_pending = true;
+			SCB->ICSR |= SCB_ICSR_PENDSTSET_Msk;
+		}
+		st_cleared = false;
+		st_val = (uint32_t)(systick_period() - 1);
+	}
+	st_val -= (uint32_t)edges;
+	SysTick->VAL = st_val;
+}
+
+// Function to get the preemption priority of an exception
+static uint8_t sim_prio(IRQn_Type irq)
+{
+	return nvic_prio[(irq < 0) ? SIM_SYSTICK : irq];
+}
+
+// Function to check whether an exception is pending and enabled
+static bool sim_pending(IRQn_Type irq)
+{
+	if (irq == SysTick_IRQn)
+	{
+		return tick_pending;
+	}
+	return nvic_enabled[irq] && periph_irq(irq);
+}
+
+// Function to find the pending exception that preempts the current execution priority
+static const sim_vector_t *sim_preempting(void)
+{
+	const sim_vector_t *best = NULL;
+	uint8_t level = exec_prio;
+	for (uint8_t i = 0; i < SIM_VECTOR_COUNT; i++)
+	{
+		if (sim_prio(vectors[i].irq) < level && sim_pending(vectors[i].irq))
+		{
+			best = &vectors[i];				// Equal priorities go to the lowest exception number
+			level = sim_prio(vectors[i].irq);
+		}
+	}
+	return best;
+}
+
+// Function to run the handlers that preempt the current execution priority, nested as on the target
+static void sim_deliver(void)
+{
+	if (booted && !in_fw)
+	{
+		return;								// The test only changes inputs, the firmware takes them when it runs
+	}
+	const sim_vector_t *v;
+	while (!host_primask && (v = sim_preempting()) != NULL)
+	{
+		uint8_t saved = exec_prio;
+		exec_prio = sim_prio(v->irq);
+		if (v->irq == SysTick_IRQn)
+		{
+			tick_pending = false;
+			SCB->ICSR &= ~SCB_ICSR_PENDSTSET_Msk;
+		}
+		v->handler();
+		exec_prio = saved;
+	}
+}
+
+// Function to get the time of the next event of the board
+static uint64_t sim_next(void)
+{
+	uint64_t tick = systick_next();
+	uint64_t periph = periph_next();
+	uint64_t next = (tick < periph) ? tick : periph;
+	return (next == SIM_NEVER) ? SIM_NEVER : sim_now + next;
+}
+
+// Function to move time to a point no later than the next event
+static void sim_step(uint64_t to)
+{
+	if (to < sim_now)
+	{
+		return;
+	}
+	uint64_t cycles = to - sim_now;
+	systick_step(cycles);
+	periph_step(cycles);
+	sim_now = to;
+}
+
+// Function to take the register writes of the firmware and deliver what became pending
+void sim_sync(void)
+{
+	periph_sync();
+	systick_sync();
+	sim_deliver();
+}
+
+// Function to skip whole SysTick periods with nothing else due, each one would only run HAL_IncTick
+static void sim_skip_ticks(uint64_t t)
+{
+	uint64_t tick = systick_next();
+	if (tick == SIM_NEVER || tick_pending || st_cleared || host_primask
+		|| sim_prio(SysTick_IRQn) >= exec_prio || !(SysTick->CTRL & SysTick_CTRL_TICKINT_Msk))
+	{
+		return;
+	}
+	uint64_t limit = t - sim_now;
+	uint64_t periph = periph_next();
+	if (periph < limit)
+	{
+		limit = periph;
+	}
+	uint64_t period = systick_period() * systick_div();
+	if (tick >= limit)
+	{
+		return;
+	}
+	uint64_t k = (limit - tick) / period;
+	if (k == 0)
+	{
+		return;
+	}
+	periph_step(k * period);
+	sim_now += k * period;
+	uwTick += (uint32_t)(k * uwTickFreq);
+}
+
+// Function to run the board up to a time, the interrupts of the way are taken in order
+static void sim_advance_to(uint64_t t)
+{
+	for (;;)
+	{
+		sim_sync();
+		if (!booted)
+		{
+			sim_skip_ticks(t);
+		}
+		uint64_t next = sim_next();
+		if (next > t)
+		{
+			break;
+		}
+		sim_step(next);
+	}
+	sim_step(t);
+	sim_sync();
+}
+
+// Function to check whether a pending interrupt ends a WFI, the mask only keeps it from being taken
+static bool sim_wake(void)
+{
+	for (uint8_t i = 0; i < SIM_VECTOR_COUNT; i++)
+	{
+		if (sim_prio(vectors[i].irq) < exec_prio && sim_pending(vectors[i].irq))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Function to hand the core back to the test at the end of a host_run step
+static void sim_yield(void)
+{
+	swapcontext(&fw_ctx, &test_ctx);
+}
+
+// Function to let the firmware run until it sleeps past the end of the step, each context keeps its PRIMASK
+static void sim_resume(void)
+{
+	uint32_t primask = host_primask;
+	host_primask = fw_primask;
+	in_fw = true;
+	swapcontext(&test_ctx, &fw_ctx);
+	in_fw = false;
+	fw_primask = host_primask;
+	host_primask = primask;
+}
+
+// Function to sleep until an interrupt is pending, STOP also freezes the core clock and the timers
+static void sim_idle(bool stop)
+{
+	sim_sync();
+	sim_stopped = stop;
+	while (!sim_wake())
+	{
+		uint64_t next = sim_next();
+		if (booted && in_fw && next > run_until)
+		{
+			sim_step(run_until);
+			sim_yield();					// The test may change inputs, then asks for a later time
+		}
+		else if (next == SIM_NEVER)
+		{
+			fprintf(stderr, "host: WFI at %llu us with nothing left to wake the core\n", (unsigned long long)(sim_now / SIM_CYCLES_US));
+			abort();
+		}
+		else
+		{
+			sim_step(next);
+		}
+		periph_sync();
+		systick_sync();
+	}
+	if (stop)
+	{
+		// Only the RTC counts while the clock restarts, an alarm due meanwhile is not lost
+		uint64_t end = sim_now + (uint64_t)(flash_pd ? SIM_WAKE_DEEP_US : SIM_WAKE_STOP_US) * SIM_CYCLES_US;
+		for (uint64_t next = sim_next(); next <= end; next = sim_next())
+		{
+			sim_step(next);
+		}
+		sim_step(end);
+		sim_stopped = false;
+	}
+	sim_deliver();
+}
+
+// Function to change PRIMASK, clearing it takes the interrupts that were held back
+void host_irq_set(uint32_t primask)
+{
+	host_primask = primask & 1;
+	if (!host_primask)
+	{
+		sim_sync();
+	}
+}
+
+// Function to execute WFI
+void host_wfi(void)
+{
+	sim_idle(false);
+}
+
+// Function to read the HAL tick, each read takes a core cycle so busy waits move time on
+uint32_t HAL_GetTick(void)
+{
+	if (booted && in_fw && sim_now > run_until + (uint64_t)SIM_BUSY_LIMIT_S * SIM_HSI_HZ)
+	{
+		fprintf(stderr, "host: firmware busy for %u s past the step without sleeping\n", SIM_BUSY_LIMIT_S);
+		abort();
+	}
+	sim_advance_to(sim_now + SIM_TICK_READ * sim_hclk_div());
+	return uwTick;
+}
+
+// Function to count a SysTick period
+void HAL_IncTick(void)
+{
+	uwTick += uwTickFreq;
+}
+
+// Function to start SysTick at 1 kHz from the core clock
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
+{
+	SysTick->LOAD = SystemCoreClock / (1000U / uwTickFreq) - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+	HAL_NVIC_SetPriority(SysTick_IRQn, TickPriority, 0);
+	uwTickPrio = TickPriority;
+	sim_sync();
+	return HAL_OK;
+}
+
+// Function to initialise the HAL as HAL_Init does
+HAL_StatusTypeDef HAL_Init(void)
+{
+	HAL_InitTick(TICK_INT_PRIORITY);
+	HAL_MspInit();
+	return HAL_OK;
+}
+
+// Function to stop the tick interrupt, the counter keeps running
+void HAL_SuspendTick(void)
+{
+	CLEAR_BIT(SysTick->CTRL, SysTick_CTRL_TICKINT_Msk);
+}
+
+// Function to restart the tick interrupt
+void HAL_ResumeTick(void)
+{
+	SET_BIT(SysTick->CTRL, SysTick_CTRL_TICKINT_Msk);
+}
+
+// Function to set the preemption priority of an interrupt, the M0+ has no subpriority
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	nvic_prio[(IRQn < 0) ? SIM_SYSTICK : IRQn] = PreemptPriority & 3;
+}
+
+// Function to enable an interrupt, a pending request is taken at once
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	nvic_enabled[IRQn] = true;
+	sim_sync();
+}
+
+// Function to disable an interrupt
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	nvic_enabled[IRQn] = false;
+}
+
+// Function to enter SLEEP mode
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry)
+{
+	sim_idle(false);
+}
+
+// Function to enter STOP mode, the core wakes at the RUN clock it had
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry)
+{
+	sim_idle(true);
+}
+
+// Function to power the flash down in STOP, it lengthens the wake up
+void HAL_PWREx_EnableFlashPowerDown(uint32_t PowerMode)
+{
+	flash_pd = true;
+}
+
+// Function to keep the flash powered in STOP
+void HAL_PWREx_DisableFlashPowerDown(uint32_t PowerMode)
+{
+	flash_pd = false;
+}
+
+// Function to clear the registers and the core state as a reset does
+static void sim_core_reset(void)
+{
+	for (uint8_t i = 0; i < SIM_RESET_REGIONS; i++)
+	{
+		memset((void *)regions[i].base, 0, regions[i].size);
+	}
+	RCC->CR = RCC_CR_HSION | RCC_CR_HSIRDY | RCC_HSI_DIV4;
+	GPIO_TypeDef *const ports[] = { GPIOA, GPIOB, GPIOC, GPIOD, GPIOF };
+	for (uint8_t i = 0; i < sizeof(ports) / sizeof(ports[0]); i++)
+	{
+		ports[i]->MODER = 0xFFFFFFFF;		// Analog
+	}
+	SystemCoreClock = SIM_HSI_HZ / sim_hclk_div();
+	memset(nvic_enabled, 0, sizeof(nvic_enabled));
+	memset(nvic_prio, 0, sizeof(nvic_prio));
+	exec_prio = SIM_THREAD;
+	host_primask = 0;
+	fw_primask = 0;
+	tick_pending = false;
+	st_val = 0;
+	st_phase = 0;
+	st_cleared = true;
+	flash_pd = false;
+	sim_stopped = false;
+	uwTick = 0;
+	uwTickFreq = HAL_TICK_FREQ_DEFAULT;
+	uwTickPrio = 1UL << __NVIC_PRIO_BITS;
+}
+
+// Function to power the board on at time 0, the HAL is initialised for tests of single modules
+void host_reset(void)
+{
+	if (booted)
+	{
+		fprintf(stderr, "host: host_reset after host_boot, run each boot in a host_scenario\n");
+		abort();
+	}
+	sim_now = 0;
+	sim_core_reset();
+	periph_reset(true);
+	HAL_Init();
+}
+
+// Function to enter the firmware from reset
+static void sim_firmware(void)
+{
+	board_main();
+	fprintf(stderr, "host: the firmware returned from main\n");
+	abort();
+}
+
+// Function to reset the core and run the firmware until it first sleeps, the backup domain is kept
+void host_boot(void)
+{
+	static bool done;
+	if (done)
+	{
+		fprintf(stderr, "host: one boot per process, run each boot in a host_scenario\n");
+		abort();
+	}
+	done = true;
+	sim_core_reset();
+	periph_reset(false);
+	getcontext(&fw_ctx);
+	fw_ctx.uc_stack.ss_sp = fw_stack;
+	fw_ctx.uc_stack.ss_size = sizeof(fw_stack);
+	fw_ctx.uc_link = NULL;
+	makecontext(&fw_ctx, sim_firmware, 0);
+	booted = true;
+	run_until = sim_now;
+	sim_resume();
+}
+
+// Function to let time pass, a booted firmware runs until it sleeps at or after the time
+void host_advance_us(uint64_t us)
+{
+	uint64_t t = sim_now + us * SIM_CYCLES_US;
+	if (!booted)
+	{
+		sim_advance_to(t);
+		return;
+	}
+	if (t > run_until)
+	{
+		run_until = t;
+	}
+	if (sim_now < run_until)
+	{
+		sim_resume();
+	}
+}
+
+// Function to let time pass in milliseconds
+void host_advance_ms(uint64_t ms)
+{
+	host_advance_us(ms * 1000);
+}
+
+// Function to run the booted firmware
+void host_run_us(uint64_t us)
+{
+	host_advance_us(us);
+}
+
+// Function to run the booted firmware in milliseconds
+void host_run_ms(uint64_t ms)
+{
+	host_advance_us(ms * 1000);
+}
+
+// Function to get the virtual time
+uint64_t host_time_us(void)
+{
+	return sim_now / SIM_CYCLES_US;
+}
+
+// Function to check whether the core is in STOP
+bool host_stopped(void)
+{
+	return sim_stopped;
+}
+
+// Function to run a scenario in a child process from power on, so each one can boot the firmware
+int host_scenario(const char *name, void (*run)(void))
+{
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		host_failures = 0;
+		host_reset();
+		run();
+		printf("  %s: %s\n", name, host_failures ? "FAIL" : "ok");
+		fflush(stdout);
+		_exit(host_failures ? 1 : 0);
+	}
+	int status = 0;
+	if (pid < 0 || waitpid(pid, &status, 0) != pid)
+	{
+		status = -1;
+	}
+	bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	if (!WIFEXITED(status))
+	{
+		printf("  %s: crashed\n", name);
+	}
+	if (!ok)
+	{
+		host_failures++;
+	}
+	return ok ? 0 : 1;
+}
+
+// Function to print the verdict of a test
+int host_result(const char *name)
+{
+	printf("%s: %s\n", name, host_failures ? "FAIL" : "ok");
+	return host_failures ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+// Host simulator internals shared by the core model (sim.c) and the peripheral models (hal_stub.c).
+// Time counts HSI48 cycles, every clock of the board is an integer division of it.
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "main.h"
+
+#define SIM_HSI_HZ		48000000u			// Virtual cycles per second
+#define SIM_NEVER		UINT64_MAX			// No event scheduled
+
+extern uint64_t sim_now;					// Virtual time in HSI48 cycles
+extern bool sim_stopped;					// Core in STOP, only the RTC and EXTI keep running
+
+uint32_t sim_hclk_div(void);				// HSI48 cycles per HCLK cycle
+uint32_t sim_pclk_div(void);				// HSI48 cycles per PCLK cycle
+uint32_t sim_timclk_div(void);				// HSI48 cycles per timer clock cycle, twice PCLK when the APB is divided
+void sim_sync(void);						// Apply register writes and deliver what became pending
+
+// Peripheral models, hal_stub.c
+void periph_reset(bool power_on);			// Reset state, the backup domain survives unless power_on
+void periph_sync(void);						// Take the register writes of the firmware into the models
+uint64_t periph_next(void);					// Cycles to the next peripheral event, SIM_NEVER if none
+void periph_step(uint64_t cycles);			// Let the peripherals run, never past periph_next
+bool periph_irq(IRQn_Type irq);				// Interrupt request line of a peripheral
+
+// Function to count the edges of a divided clock over a span, phase holds the cycles into the current period
+static inline uint64_t sim_edges(uint32_t *phase, uint64_t cycles, uint32_t div)
+{
+	uint64_t t = (*phase < div ? *phase : 0) + cycles;
+	*phase = (uint32_t)(t % div);
+	return t / div;
+}
+
+// Function to get the cycles until a number of edges of a divided clock
+static inline uint64_t sim_after(uint32_t phase, uint64_t edges, uint32_t div)
+{
+	return edges * div - (phase < div ? phase : 0);
+}
+
+#endif /* SIM_H */
@@ -0,0 +1,72 @@
+// Program Description: Host scenarios of the battery monitor on the simulated board, reports, low battery and servo sag.
+
+#include "host.h"
+#include "soc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Function to get the number following a text in the console output, 0 if the text is missing
+static uint32_t console_value(const char *text)
+{
+	const char *p = strstr(host_console(), text);
+	return p ? (uint32_t)strtoul(p + strlen(text), NULL, 10) : 0;
+}
+
+// A day of hourly watchdog checks ends with a full report close to the pack voltage
+static void daily_report(void)
+{
+	host_boot();
+	host_run_ms(10000);
+	host_console_clear();
+	host_run_ms(24 * 3600 * 1000ULL + 60000);
+	uint32_t mv = console_value("Battery Voltage: ");
+	CHECK(mv >= 5980 && mv <= 6020);
+	CHECK(console_value("SoC ") > 80);
+	CHECK(host_stopped());
+}
+
+// Below the cutoff the watchdog check trips within the hour and the full measurement reports it
+static void low_battery(void)
+{
+	host_boot();
+	host_run_ms(10000);
+	host_console_clear();
+	host_set_battery(4600, 400);
+	host_run_ms(3600 * 1000 + 60000);
+	uint32_t mv = console_value("Battery Voltage: ");
+	CHECK(mv >= 4580 && mv <= 4620);
+	CHECK(mv < SOC_CUTOFF_MV);
+}
+
+// A weak pack sags under the servo, the capture of the opening motion sees the drop
+static void servo_sag(void)
+{
+	host_set_battery(6000, 1200);			// 300 mV drop at the 250 mA of a turning servo
+	host_boot();
+	host_run_ms(3000);
+	CHECK(console_value("Sag rest ") >= 5980);
+	CHECK(console_value("min ") <= 5710);
+	CHECK(console_value("after ") >= 5980);
+	CHECK(console_value("R ") >= 200);
+}
+
+// The 'b' console command measures the battery at once
+static void measure_command(void)
+{
+	host_boot();
+	host_run_ms(2000);
+	host_set_battery(5500, 400);
+	host_uart_rx('b');
+	host_run_ms(100);
+	uint32_t mv = console_value("Battery Voltage: ");
+	CHECK(mv >= 5480 && mv <= 5520);
+}
+
+int main(void)
+{
+	host_scenario("daily report", daily_report);
+	host_scenario("low battery", low_battery);
+	host_scenario("servo sag", servo_sag);
+	host_scenario("measure command", measure_command);
+	return host_result("battery");
+}
@@ -0,0 +1,96 @@
+// Program Description: Host scenarios of the button on the simulated board, test mode and flood reset.
+
+#include "host.h"
+#include "valve.h"
+#include <string.h>
+
+// Function to boot dry and wait for the opened valve and the first STOP
+static void boot_open(void)
+{
+	host_boot();
+	host_run_ms(8000);
+	CHECK(host_servo_pulse() == VALVE_PULSE_OPEN);
+	CHECK(host_stopped());
+	host_console_clear();
+}
+
+// Function to hold the button down for a time and release it
+static void press(uint32_t ms)
+{
+	host_set_pin(BUTTON_GPIO_Port, BUTTON_Pin, HOST_PIN_LOW);
+	host_run_ms(ms);
+	host_set_pin(BUTTON_GPIO_Port, BUTTON_Pin, HOST_PIN_OPEN);
+}
+
+// Function to run the firmware in 1 ms steps and record the furthest the valve moved from open
+static uint16_t run_watch_valve(uint32_t ms, bool *led)
+{
+	uint16_t furthest = host_servo_pulse();
+	for (uint32_t i = 0; i < ms; i++)
+	{
+		host_run_ms(1);
+		furthest = (host_servo_pulse() > furthest) ? host_servo_pulse() : furthest;
+		*led |= host_pin_out(STATUS_LED_GPIO_Port, STATUS_LED_Pin);
+	}
+	return furthest;
+}
+
+// A long press runs the test mode: status blink, close, alert, reopen
+static void test_mode(void)
+{
+	boot_open();
+	press(2500);
+	bool led = false;
+	CHECK(run_watch_valve(5000, &led) == VALVE_PULSE_CLOSED);
+	CHECK(led);
+	CHECK(host_servo_pulse() == VALVE_PULSE_OPEN);
+	CHECK(!host_servo_powered());
+	host_run_ms(6000);
+	CHECK(host_stopped());
+}
+
+// A short press outside a flood leaves the valve alone
+static void short_press(void)
+{
+	boot_open();
+	press(300);
+	bool led = false;
+	CHECK(run_watch_valve(3000, &led) == VALVE_PULSE_OPEN);
+	CHECK(!host_servo_powered());
+	CHECK(strstr(host_console(), "valve open") == NULL);
+}
+
+// Once the probes are dry, a one second press resets the flood and reopens the valve
+static void flood_reset(void)
+{
+	boot_open();
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_WET);
+	host_run_ms(2000);
+	CHECK(host_servo_pulse() == VALVE_PULSE_CLOSED);
+
+	// Still wet: the press is refused
+	press(1200);
+	host_run_ms(2000);
+	CHECK(strstr(host_console(), "valve open") == NULL);
+	CHECK(host_servo_pulse() == VALVE_PULSE_CLOSED);
+
+	// Dry: the valve reopens with the gentle ramp and the alerts stop
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_OPEN);
+	host_run_ms(100);
+	press(1200);
+	host_run_ms(2000);
+	CHECK(strstr(host_console(), "valve open\r\n") != NULL);
+	CHECK(host_servo_pulse() == VALVE_PULSE_OPEN);
+	host_console_clear();
+	host_run_ms(10000);
+	CHECK(strstr(host_console(), "Flood") == NULL);
+	CHECK(host_stopped());
+}
+
+int main(void)
+{
+	host_scenario("test mode", test_mode);
+	host_scenario("short press", short_press);
+	host_scenario("flood reset", flood_reset);
+	return host_result("button");
+}
@@ -0,0 +1,145 @@
+// Program Description: Host test of the N of M debounce against noisy probe traces and a brute force reference.
+
+#include "host.h"
+#include "debounce.h"
+
+// Probe trace in sample order, 'W' wet and 'D' dry
+typedef struct
+{
+	const char *name;
+	const char *samples;
+	debounce_result_t verdict;				// Expected verdict
+	uint8_t taken;							// Samples taken when it is reached
+} trace_case_t;
+
+// The shipped flood configuration: 6 of the last 8 samples within 10, every 10 ms
+static const debounce_config_t flood = { 10, 8, 6, 10 };
+
+static const trace_case_t cases[] =
+{
+	{ "steady flood", "WWWWWWWWWW", DEBOUNCE_CONFIRMED, 6 },
+	{ "dry glitch", "DDDDDDDDDD", DEBOUNCE_REJECTED, 5 },
+	{ "splash", "WWDDDDDDDD", DEBOUNCE_REJECTED, 5 },
+	{ "bouncing contact", "WDWWDWWWWW", DEBOUNCE_CONFIRMED, 8 },
+	{ "condensation flicker", "WDWDWDWDWD", DEBOUNCE_REJECTED, 8 },
+	{ "slow wetting", "DDDDWWWWWW", DEBOUNCE_CONFIRMED, 10 },
+	{ "wetting too late", "DDDDDWWWWW", DEBOUNCE_REJECTED, 5 },
+	{ "drip", "WDDWDDWDDW", DEBOUNCE_REJECTED, 6 },
+};
+
+#define CASE_COUNT		(sizeof(cases) / sizeof(cases[0]))
+
+// Function to run a trace given as bits, bit i is sample i, until a verdict
+static debounce_result_t run_bits(const debounce_config_t *cfg, uint32_t bits, uint8_t *taken)
+{
+	debounce_t d;
+	debounce_start(&d, cfg);
+	debounce_result_t verdict = DEBOUNCE_PENDING;
+	for (uint8_t i = 0; i < 32 && verdict == DEBOUNCE_PENDING; i++)
+	{
+		verdict = debounce_sample(&d, (bits >> i) & 1);
+	}
+	*taken = d.taken;
+	return verdict;
+}
+
+// Function to find the first sample at which the reference rule holds, N of the latest M, 0 if none within K
+static uint8_t reference_confirm(const debounce_config_t *cfg, uint32_t bits)
+{
+	for (uint8_t t = 1; t <= cfg->max_samples; t++)
+	{
+		uint8_t wet = 0;
+		for (uint8_t i = (t > cfg->window) ? t - cfg->window : 0; i < t; i++)
+		{
+			wet += (bits >> i) & 1;
+		}
+		if (wet >= cfg->votes)
+		{
+			return t;
+		}
+	}
+	return 0;
+}
+
+// Function to check whether some continuation of the first t samples still confirms
+static bool reference_reachable(const debounce_config_t *cfg, uint32_t bits, uint8_t t)
+{
+	uint32_t prefix = bits & ((1u << t) - 1);
+	for (uint32_t rest = 0; rest < (1u << (cfg->max_samples - t)); rest++)
+	{
+		if (reference_confirm(cfg, prefix | (rest << t)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Function to compare the engine with the reference for every trace of K samples
+static void check_exhaustive(const debounce_config_t *cfg)
+{
+	for (uint32_t bits = 0; bits < (1u << cfg->max_samples); bits++)
+	{
+		uint8_t taken;
+		debounce_result_t verdict = run_bits(cfg, bits, &taken);
+		uint8_t confirm = reference_confirm(cfg, bits);
+		CHECK(verdict != DEBOUNCE_PENDING);
+		CHECK(taken <= cfg->max_samples);	// Bounded detect latency
+		if (confirm)
+		{
+			CHECK(verdict == DEBOUNCE_CONFIRMED);
+			CHECK(taken == confirm);		// Confirmed as soon as the rule holds
+		}
+		else
+		{
+			CHECK(verdict == DEBOUNCE_REJECTED);
+			CHECK(!reference_reachable(cfg, bits, taken));	// Never rejected while a flood was still possible
+			CHECK(taken == 1 || reference_reachable(cfg, bits, taken - 1));	// Rejected as early as possible
+		}
+	}
+}
+
+int main(void)
+{
+	// Recorded style traces at the N = 6, M = 8, K = 10 edges
+	for (uint8_t c = 0; c < CASE_COUNT; c++)
+	{
+		uint32_t bits = 0;
+		for (uint8_t i = 0; cases[c].samples[i]; i++)
+		{
+			bits |= (uint32_t)(cases[c].samples[i] == 'W') << i;
+		}
+		uint8_t taken;
+		debounce_result_t verdict = run_bits(&flood, bits, &taken);
+		if (verdict != cases[c].verdict || taken != cases[c].taken)
+		{
+			printf("%s: verdict %d after %u samples\n", cases[c].name, verdict, taken);
+		}
+		CHECK(verdict == cases[c].verdict);
+		CHECK(taken == cases[c].taken);
+	}
+
+	// Every trace of the shipped configuration and of a few others
+	static const debounce_config_t configs[] =
+	{
+		{ 10, 8, 6, 10 },
+		{ 10, 4, 3, 6 },
+		{ 10, 8, 8, 8 },
+		{ 10, 1, 1, 4 },
+		{ 10, 12, 5, 12 },
+	};
+	for (uint8_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+	{
+		check_exhaustive(&configs[i]);
+	}
+
+	// A window wider than the samples taken still votes, the full 32 sample window counts every bit
+	static const debounce_config_t wide = { 10, 32, 32, 32 };
+	uint8_t taken;
+	CHECK(run_bits(&wide, 0xFFFFFFFF, &taken) == DEBOUNCE_CONFIRMED && taken == 32);
+	CHECK(run_bits(&wide, 0xFFFFFFFE, &taken) == DEBOUNCE_REJECTED && taken == 1);
+
+	// TIM16 auto reload for the sample interval
+	CHECK(debounce_period(&flood) == 10 * DEBOUNCE_TICKS_PER_MS - 1);
+	return host_result("debounce");
+}
@@ -0,0 +1,172 @@
+// Program Description: Host scenarios of the flood path on the simulated board, from the probe edge to the closed valve.
+
+#include "host.h"
+#include "valve.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CLOSE_BUDGET_MS		350				// FLOOD_CLOSE_BUDGET of app_main.c, probe edge to closed valve
+
+// Function to get the number following a text in the console output, 0 if the text is missing
+static uint32_t console_value(const char *text)
+{
+	const char *p = strstr(host_console(), text);
+	return p ? (uint32_t)strtoul(p + strlen(text), NULL, 10) : 0;
+}
+
+// Function to run the firmware in 1 ms steps and watch the warning LED
+static bool run_watch_warning(uint32_t ms)
+{
+	bool seen = false;
+	for (uint32_t i = 0; i < ms; i++)
+	{
+		host_run_ms(1);
+		seen |= host_pin_out(WARNING_LED_GPIO_Port, WARNING_LED_Pin);
+	}
+	return seen;
+}
+
+// Function to find the latest trace entry of a stage, NULL if the ring has none
+static const trace_entry_t *trace_find(trace_id_t id)
+{
+	for (uint8_t i = trace_count(); i > 0; i--)
+	{
+		if (trace_get(i - 1)->id == id)
+		{
+			return trace_get(i - 1);
+		}
+	}
+	return NULL;
+}
+
+// Function to boot dry and wait for the opened valve and the first STOP
+static void boot_open(void)
+{
+	host_boot();
+	host_run_ms(8000);
+	CHECK(host_servo_pulse() == VALVE_PULSE_OPEN);
+	CHECK(!host_servo_powered());
+	CHECK(host_stopped());
+	host_console_clear();
+}
+
+// Water on the first probe: the alert starts, the valve closes within the budget and the flood repeats
+static void flood_closes(void)
+{
+	boot_open();
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_WET);
+	CHECK(run_watch_warning(1000));
+	CHECK(strstr(host_console(), "Flood\r\n") != NULL);
+	CHECK(strstr(host_console(), "valve closed ") != NULL);
+	CHECK(strstr(host_console(), "over budget") == NULL);
+	CHECK(console_value("valve closed ") <= 350);
+	CHECK(host_servo_pulse() == VALVE_PULSE_CLOSED);
+	host_run_ms(6000);
+	CHECK(!host_servo_powered());
+	CHECK(strstr(strstr(host_console(), "Flood\r\n") + 1, "Flood\r\n") != NULL);	// Repeated every 5 s
+	CHECK(!host_stopped());					// A flood keeps the core out of STOP
+}
+
+// Function to time the probe edge to the servo at the closed end on the virtual clock, from STOP
+static void close_latency(void)
+{
+	CHECK(host_stopped());
+	uint64_t edge = host_time_us();
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_WET);
+	while (host_servo_pulse() != VALVE_PULSE_CLOSED && host_time_us() - edge < 1000000)
+	{
+		host_run_us(100);
+	}
+	uint32_t closed_ms = (uint32_t)((host_time_us() - edge + 999) / 1000);
+	host_run_ms(500);
+
+	// Pipeline stages in order, the firmware measures from the first debounce edge to the end of the ramp
+	const trace_entry_t *stages[] =
+	{
+		trace_find(TRACE_FLOOD_EDGE), trace_find(TRACE_DEBOUNCE_START), trace_find(TRACE_FLOOD_CONFIRM),
+		trace_find(TRACE_VALVE_START), trace_find(TRACE_VALVE_END)
+	};
+	for (uint8_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++)
+	{
+		CHECK(stages[i] != NULL);
+		if (stages[i] == NULL)
+		{
+			return;
+		}
+		CHECK(i == 0 || stages[i]->time_us >= stages[i - 1]->time_us);
+		printf("    %-8s +%6uus\n", trace_name(stages[i]->id), (unsigned)(stages[i]->time_us - stages[0]->time_us));
+	}
+	uint32_t ramp_ms = (stages[4]->time_us - stages[0]->time_us) / 1000;
+	uint32_t reported = console_value("valve closed ");
+	printf("    servo closed after %ums, firmware reported %ums\n", (unsigned)closed_ms, (unsigned)reported);
+	CHECK(closed_ms <= CLOSE_BUDGET_MS);
+	CHECK(reported <= CLOSE_BUDGET_MS);
+	CHECK(reported + 2 >= ramp_ms && reported <= ramp_ms + 2);
+	CHECK(closed_ms + 2 >= reported);		// The servo cannot be there before the ramp ends
+	CHECK(strstr(host_console(), "over budget") == NULL);
+}
+
+// Edge to closed valve within the budget, waking from STOP with the flash on
+static void budget_stop(void)
+{
+	boot_open();
+	close_latency();
+}
+
+// Edge to closed valve within the budget, waking from STOP with the flash powered down
+static void budget_deep(void)
+{
+	host_boot();
+	host_run_ms(1000);
+	host_uart_rx('d');
+	host_run_ms(8000);
+	CHECK(strstr(host_console(), "sleep deep") != NULL);
+	close_latency();
+}
+
+// The second probe closes the valve the same way
+static void second_probe(void)
+{
+	boot_open();
+	host_set_pin(FLOOD_SENSOR2_GPIO_Port, FLOOD_SENSOR2_Pin, HOST_PIN_WET);
+	host_run_ms(1000);
+	CHECK(strstr(host_console(), "Flood\r\n") != NULL);
+	CHECK(host_servo_pulse() == VALVE_PULSE_CLOSED);
+}
+
+// A splash shorter than the debounce window is rejected and the valve stays open
+static void splash(void)
+{
+	boot_open();
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_WET);
+	host_run_ms(15);
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_OPEN);
+	host_run_ms(2000);
+	CHECK(strstr(host_console(), "Flood") == NULL);
+	CHECK(host_servo_pulse() == VALVE_PULSE_OPEN);
+	CHECK(!host_servo_powered());
+	host_run_ms(6000);
+	CHECK(host_stopped());
+}
+
+// Water at power on: the valve is closed during the boot and the flood is reported
+static void wet_at_boot(void)
+{
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_WET);
+	host_boot();
+	host_run_ms(3000);
+	CHECK(strstr(host_console(), "Flood\r\n") != NULL);
+	CHECK(host_servo_pulse() == VALVE_PULSE_CLOSED);
+}
+
+int main(void)
+{
+	host_scenario("flood closes the valve", flood_closes);
+	host_scenario("close budget from stop", budget_stop);
+	host_scenario("close budget from deep stop", budget_deep);
+	host_scenario("second probe", second_probe);
+	host_scenario("splash rejected", splash);
+	host_scenario("wet at boot", wet_at_boot);
+	return host_result("flood");
+}
@@ -0,0 +1,110 @@
+// Program Description: Host test of the formatter against snprintf, output and speed.
+
+#include "host.h"
+#include "fmt.h"
+#include <string.h>
+#include <time.h>
+
+#define BENCH_LINES		200000				// Battery lines formatted per timing run
+#ifndef HOST_OPT
+#define HOST_OPT		"unknown"			// Build type and flags, set by CMakeLists.txt
+#endif
+
+// Values at the digit boundaries of every width
+static const uint32_t values[] =
+{
+	0, 1, 9, 10, 99, 100, 999, 1000, 4095, 9999, 10000, 65535, 99999, 100000, 999999, 1000000,
+	9999999, 10000000, 99999999, 100000000, 999999999, 1000000000, 2147483647, 2147483648u, 4294967295u
+};
+
+#define VALUE_COUNT		(sizeof(values) / sizeof(values[0]))
+
+// Function to build the battery report line of monitorBattery with the formatter
+static char *line_fmt(char *dst, uint32_t i)
+{
+	char *p = fmt_str(dst, "Battery Voltage: ");
+	p = fmt_u32(p, 4800 + (i & 63));
+	p = fmt_str(p, "mV VDDA ");
+	p = fmt_u32(p, 3300);
+	p = fmt_str(p, "mV trend ");
+	p = fmt_i32(p, -(int32_t)(i & 7));
+	p = fmt_str(p, "mV spread ");
+	p = fmt_u32(p, 12);
+	p = fmt_str(p, "mV sample ");
+	p = fmt_u32(p, 260);
+	p = fmt_str(p, "us ");
+	p = fmt_u32(p, 1480);
+	return fmt_str(p, "nJ\r\n");
+}
+
+// Function to build the same line with snprintf
+static int line_printf(char *dst, uint32_t i)
+{
+	return snprintf(dst, 112, "Battery Voltage: %lumV VDDA %lumV trend %ldmV spread %lumV sample %luus %lunJ\r\n",
+			4800ul + (i & 63), 3300ul, -(long)(i & 7), 12ul, 260ul, 1480ul);
+}
+
+// Function to get a monotonic time in ns
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+int main(void)
+{
+	char a[112];
+	char b[112];
+
+	// Every formatter matches its printf conversion
+	for (uint8_t i = 0; i < VALUE_COUNT; i++)
+	{
+		uint32_t v = values[i];
+		fmt_u32(a, v);
+		snprintf(b, sizeof(b), "%lu", (unsigned long)v);
+		CHECK(strcmp(a, b) == 0);
+		fmt_i32(a, (int32_t)v);
+		snprintf(b, sizeof(b), "%ld", (long)(int32_t)v);
+		CHECK(strcmp(a, b) == 0);
+		fmt_hex(a, v, 8);
+		snprintf(b, sizeof(b), "%08lX", (unsigned long)v);
+		CHECK(strcmp(a, b) == 0);
+		fmt_mv(a, v);
+		snprintf(b, sizeof(b), "%lu.%03lu", (unsigned long)(v / 1000), (unsigned long)(v % 1000));
+		CHECK(strcmp(a, b) == 0);
+	}
+	fmt_hex(a, 0xA5, 2);
+	CHECK(strcmp(a, "A5") == 0);
+	fmt_time(a, 61005);
+	CHECK(strcmp(a, "61.005") == 0);
+
+	// Chained calls return the terminator and build the same line
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		char *end = line_fmt(a, i);
+		int n = line_printf(b, i);
+		CHECK(strcmp(a, b) == 0);
+		CHECK(end - a == n);
+	}
+
+	// Time per line, host cycles only rank the two, the target count comes from the 'c' console command
+	volatile uint32_t sink = 0;
+	uint64_t t0 = now_ns();
+	for (uint32_t i = 0; i < BENCH_LINES; i++)
+	{
+		sink += line_fmt(a, i) - a;
+	}
+	uint64_t t1 = now_ns();
+	for (uint32_t i = 0; i < BENCH_LINES; i++)
+	{
+		sink += line_printf(b, i);
+	}
+	uint64_t t2 = now_ns();
+	printf("battery line: fmt %lu ns, snprintf %lu ns, built %s\n",
+			(unsigned long)((t1 - t0) / BENCH_LINES), (unsigned long)((t2 - t1) / BENCH_LINES), HOST_OPT);
+#ifndef __OPTIMIZE__
+	printf("unoptimised build, the timings do not rank the formatter\n");
+#endif
+	return host_result("fmt");
+}
@@ -0,0 +1,72 @@
+// Program Description: Host scenarios of the power model over a simulated day, average current and charge per day.
+
+#include "host.h"
+#include "power.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Function to get the number following a text in the console output, 0 if the text is missing
+static uint32_t console_value(const char *text)
+{
+	const char *p = strstr(host_console(), text);
+	return p ? (uint32_t)strtoul(p + strlen(text), NULL, 10) : 0;
+}
+
+// Function to wake the board with a short press and ask for the power report
+static void report(void)
+{
+	host_set_pin(BUTTON_GPIO_Port, BUTTON_Pin, HOST_PIN_LOW);
+	host_run_ms(100);
+	host_set_pin(BUTTON_GPIO_Port, BUTTON_Pin, HOST_PIN_OPEN);
+	host_run_ms(10);
+	host_console_clear();
+	host_uart_rx('p');
+	host_run_ms(200);
+	const char *p = strstr(host_console(), "P up=");
+	if (p != NULL)
+	{
+		printf("    %.*s\n", (int)strcspn(p, "\r"), p);
+	}
+}
+
+// Function to check the report against the model and the charge per day it implies
+static void check_day(power_state_t sleep)
+{
+	uint32_t avg = power_avg_ua();
+	uint32_t reported = console_value("s avg=");
+	CHECK(console_value("P up=") >= 24 * 3600);
+	CHECK(reported >= avg - 1 && reported <= avg + 1);	// The report was made a few ms before
+	CHECK(power_time_ms(sleep) > 23 * 3600 * 1000);	// STOP all day but for the wakes
+	// The status blink and beep of every minute add about 45 uA to the STOP current
+	uint32_t floor = (sleep == POWER_STOP) ? POWER_UA_STOP : POWER_UA_DEEP_STOP;
+	CHECK(avg > floor + 30 && avg < floor + 60);
+	const char *mah = strstr(host_console(), "uA ");
+	CHECK(mah != NULL && (uint32_t)(strtod(mah + 3, NULL) * 1000 + 0.5) == avg * 24);
+}
+
+// A quiet day in STOP with a status wake a minute
+static void stop_day(void)
+{
+	host_boot();
+	host_run_ms(24 * 3600 * 1000ULL);
+	report();
+	check_day(POWER_STOP);
+}
+
+// The same day with the flash powered down in STOP costs less
+static void deep_day(void)
+{
+	host_boot();
+	host_run_ms(1000);
+	host_uart_rx('d');
+	host_run_ms(24 * 3600 * 1000ULL);
+	report();
+	check_day(POWER_DEEP_STOP);
+}
+
+int main(void)
+{
+	host_scenario("stop day", stop_day);
+	host_scenario("deep stop day", deep_day);
+	return host_result("power");
+}
@@ -0,0 +1,69 @@
+// Program Description: Host scenario of the scheduler awake time accounting over a simulated day with a flood.
+
+#include "host.h"
+#include "scheduler.h"
+#include "battery.h"
+#include <string.h>
+
+static const char *const names[EVT_COUNT] =
+{
+	[EVT_FLOOD] = "flood",
+	[EVT_BUTTON_RELEASE] = "button",
+	[EVT_ALERT_TIMER] = "alert",
+	[EVT_SLEEP_TIMER] = "sleep",
+	[EVT_VALVE_DONE] = "valve",
+	[EVT_STOP_READY] = "stop",
+	[EVT_TEST_STEP] = "test",
+	[EVT_UART_CMD] = "uart",
+	[EVT_TRACE_DUMP] = "dump",
+	[EVT_WAKE_JOBS] = "wake",
+};
+
+// Function to print the awake time of every event dispatched so far
+static void print_stats(void)
+{
+	for (uint8_t evt = EVT_NONE + 1; evt < EVT_COUNT; evt++)
+	{
+		const sched_stats_t *st = sched_stats((sched_event_t)evt);
+		if (st->count)
+		{
+			printf("    %-6s n=%5u avg=%5uus max=%5uus\n", names[evt], (unsigned)st->count,
+					(unsigned)(st->busy_us / st->count), (unsigned)st->max_us);
+		}
+	}
+}
+
+// A day of RTC wakes after a flood and its reset, the awake time of each event is bounded by what it waits for.
+// The simulated core executes in no time, so the figures are the peripheral waits of each handler.
+static void awake_day(void)
+{
+	host_boot();
+	host_run_ms(8000);
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_WET);
+	host_run_ms(6000);
+	host_set_pin(FLOOD_SENSOR_GPIO_Port, FLOOD_SENSOR_Pin, HOST_PIN_OPEN);
+	host_set_pin(BUTTON_GPIO_Port, BUTTON_Pin, HOST_PIN_LOW);
+	host_run_ms(1200);
+	host_set_pin(BUTTON_GPIO_Port, BUTTON_Pin, HOST_PIN_OPEN);
+	host_run_ms(24 * 3600 * 1000ULL);
+	print_stats();
+
+	const sched_stats_t *wake = sched_stats(EVT_WAKE_JOBS);
+	CHECK(wake->count >= 24 * 60 && wake->count <= 24 * 60 + 25);	// A status wake a minute, the hourly battery check may fall between
+	CHECK(wake->max_us >= BATT_SETTLE_US);	// The hourly battery check waits for the divider
+	CHECK(wake->max_us < 5000);
+	CHECK(wake->busy_us / wake->count < 100);	// Most wakes only blink and program the next alarm
+	CHECK(sched_stats(EVT_FLOOD)->count == 1);
+	CHECK(sched_stats(EVT_ALERT_TIMER)->count >= 1);
+	CHECK(sched_stats(EVT_BUTTON_RELEASE)->count == 1);
+	CHECK(sched_stats(EVT_VALVE_DONE)->count == 3);	// Boot open, flood close, reset open
+	CHECK(sched_stats(EVT_VALVE_DONE)->max_us >= BATT_SETTLE_US);	// Each one measures the recovered battery
+	CHECK(sched_stats(EVT_FLOOD)->max_us < 1000);	// The close was started from the debounce interrupt
+	CHECK(strstr(host_console(), "E10 n=") != NULL);	// The firmware reported the same figures at its daily battery report
+}
+
+int main(void)
+{
+	host_scenario("awake time over a day", awake_day);
+	return host_result("sched");
+}
@@ -0,0 +1,71 @@
+// Program Description: Host test of the state of charge estimator over days of virtual time.
+
+#include "host.h"
+#include "soc.h"
+#include "power.h"
+
+// Function to feed one battery reading per virtual hour
+static void run_hours(uint32_t hours, uint16_t mv)
+{
+	for (uint32_t h = 0; h < hours; h++)
+	{
+		host_advance_ms(3600000);
+		soc_update(mv);
+	}
+}
+
+int main(void)
+{
+	host_reset();
+	soc_init();
+	CHECK(soc_status()->mv == 0);
+	CHECK(soc_status()->days == 0);
+
+	// Curve end points and interpolation between 6080 mV (90 %) and 5840 mV (80 %)
+	CHECK(soc_permille(7000) == 1000);
+	CHECK(soc_permille(3000) == 0);
+	CHECK(soc_permille(6000) == 866);
+	for (uint16_t mv = 4000; mv < 6400; mv += 10)
+	{
+		CHECK(soc_permille(mv + 10) >= soc_permille(mv));
+	}
+
+	// Two days at 6.0 V in STOP: the load is the STOP current of the power model, (866 - 155) / slope days to the 4.75 V cutoff
+	uint32_t slope = (uint32_t)POWER_UA_STOP * 24 * 1000 / SOC_CAPACITY_MAH;
+	power_init();
+	power_begin(POWER_STOP);
+	run_hours(48, 6000);
+	CHECK(soc_status()->mv == 6000);
+	CHECK(soc_status()->permille == 866);
+	CHECK(soc_status()->load_ua == POWER_UA_STOP);
+	CHECK(soc_status()->slope_ppm == slope);
+	CHECK(soc_status()->days == (866 - 155) * 1000 / slope);
+
+	// A reading dip moves the average by one eighth only
+	soc_update(5200);
+	CHECK(soc_status()->mv == 5900);
+
+	// A reset restores the averages from the backup registers
+	uint16_t mv = soc_status()->mv;
+	soc_init();
+	CHECK(soc_status()->mv == mv);
+	CHECK(soc_status()->load_ua == POWER_UA_STOP);
+
+	// The load average follows a higher current with weight one quarter
+	power_end(POWER_STOP);
+	power_init();
+	power_begin(POWER_SLEEP);
+	run_hours(1, 6000);
+	CHECK(soc_status()->load_ua == POWER_UA_STOP + ((POWER_UA_SLEEP - POWER_UA_STOP) >> SOC_LOAD_SHIFT));
+	run_hours(24, 6000);
+	CHECK(soc_status()->load_ua > POWER_UA_SLEEP - 10);
+
+	// Below the cutoff nothing is left
+	host_reset();
+	soc_init();
+	power_init();
+	power_begin(POWER_STOP);
+	run_hours(1, 4700);
+	CHECK(soc_status()->days == 0);
+	return host_result("soc");
+}
@@ -0,0 +1,40 @@
+// Program Description: Host test of the pipeline trace ring against the virtual clock.
+
+#include "host.h"
+#include "trace.h"
+
+int main(void)
+{
+	host_reset();
+	CHECK(trace_count() == 0);
+
+	// Timestamps follow the virtual clock
+	host_advance_us(100);
+	trace_record(TRACE_FLOOD_EDGE, 0);
+	host_advance_us(250);
+	trace_record(TRACE_DEBOUNCE_START, 0);
+	CHECK(trace_count() == 2);
+	CHECK(trace_get(0)->id == TRACE_FLOOD_EDGE);
+	CHECK(trace_get(1)->time_us - trace_get(0)->time_us == 250);
+
+	// A paused ring drops events
+	trace_pause(true);
+	trace_record(TRACE_VALVE_START, 1);
+	trace_pause(false);
+	CHECK(trace_count() == 2);
+
+	// Past TRACE_SIZE entries the oldest ones are overwritten
+	for (uint16_t i = 0; i < TRACE_SIZE + 8; i++)
+	{
+		host_advance_us(10);
+		trace_record(TRACE_UART_LOG, i);
+	}
+	CHECK(trace_count() == TRACE_SIZE);
+	CHECK(trace_get(0)->arg == 8);			// 42 records, the 2 first ones and 8 of the loop are gone
+	CHECK(trace_get(TRACE_SIZE - 1)->arg == TRACE_SIZE + 7);
+	CHECK(host_primask == 0);				// Every record restored the interrupt mask
+
+	CHECK(trace_name(TRACE_FLOOD_CONFIRM)[0] == 'c');
+	CHECK(trace_name(TRACE_ID_COUNT)[0] == '?');
+	return host_result("trace");
+}